@@ -0,0 +1,41 @@
+#include "allocationcounter.hpp"
+
+// C++ standard
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Per thread, so workers drawing tiles or saving in the background do not
+// show up in the count of a frame. Trivial, so no allocation sets it up
+thread_local qint64 allocations{0};
+} // namespace
+
+qint64 AllocationCounter::count()
+{
+  return allocations;
+}
+
+#ifdef SHAPES_COUNT_ALLOCATIONS
+// The array and nothrow forms call these, the aligned ones are left alone
+void* operator new(const std::size_t size)
+{
+  ++allocations;
+  void* const p{std::malloc(size > 0 ? size : 1)};
+  if (p == nullptr)
+  {
+    throw std::bad_alloc{};
+  }
+  return p;
+}
+
+void operator delete(void* const p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* const p, const std::size_t) noexcept
+{
+  std::free(p);
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Counts calls of the global operator new, so the paint loop can be checked
+// for heap allocations. Only builds defining SHAPES_COUNT_ALLOCATIONS
+// replace the operator, debug and benchmark builds do; elsewhere the count
+// stays zero. Qt containers and strings allocate through malloc and are
+// not seen, their private data such as the one of pens, brushes, paths and
+// painter states is.
+class AllocationCounter
+{
+public:
+#ifdef SHAPES_COUNT_ALLOCATIONS
+  static constexpr bool enabled{true};
+#else
+  static constexpr bool enabled{false};
+#endif
+
+  // Allocations the calling thread made since it started. Work handed to
+  // other threads, such as tiles or saving, is not included
+  static qint64 count();
+};
@@ -0,0 +1,329 @@
+#include "batchrenderer.hpp"
+#include "scenesnapshot.hpp"
+#include "traceevents.hpp"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFuture>
+#include <QGuiApplication>
+#include <QHash>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+// C++ standard
+#include <algorithm>
+#include <cstring>
+#include <ranges>
+
+namespace
+{
+QString milliseconds(const qint64 ns)
+{
+  return QString::number(ns / 1.0e6, 'f', 3);
+}
+} // namespace
+
+bool BatchRenderer::isRequested(const int argc, char* argv[])
+{
+  return std::ranges::any_of(
+    std::views::iota(1, argc),
+    [argv](const int i)
+    {
+      return std::strcmp(argv[i], switchName) == 0;
+    });
+}
+
+int BatchRenderer::run(int argc, char* argv[])
+{
+  // The platform is picked when the application is constructed
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QGuiApplication app{argc, argv};
+
+  QCommandLineParser parser{};
+  parser.setApplicationDescription("Renders saved drawings without a window");
+  parser.addHelpOption();
+  const QCommandLineOption renderOption{
+    QString{switchName}.mid(2), "Render the inputs and exit"};
+  const QCommandLineOption outputOption{
+    QStringList{"o", "output"},
+    "Directory for the images, the current one by default",
+    "dir"};
+  const QCommandLineOption formatOption{
+    QStringList{"f", "format"}, "png, jpeg or raw", "format", "png"};
+  const QCommandLineOption sizeOption{
+    QStringList{"s", "size"},
+    "Fit into WIDTHxHEIGHT keeping the aspect ratio",
+    "size"};
+  const QCommandLineOption scaleOption{
+    "scale", "Scale of the drawing, used without --size", "factor", "1"};
+  const QCommandLineOption qualityOption{
+    QStringList{"q", "quality"}, "Encoder quality, 0 to 100", "quality", "-1"};
+  const QCommandLineOption jobsOption{
+    QStringList{"j", "jobs"},
+    "Files rendered at once, one per core by default",
+    "count",
+    "0"};
+  // Taken by main() before the parser runs, listed for the help text
+  const QCommandLineOption traceOption{
+    QString{TraceEvents::switchName}.mid(2),
+    "Write Chrome trace events to the file",
+    "file"};
+  parser.addOption(renderOption);
+  parser.addOption(outputOption);
+  parser.addOption(formatOption);
+  parser.addOption(sizeOption);
+  parser.addOption(scaleOption);
+  parser.addOption(qualityOption);
+  parser.addOption(jobsOption);
+  parser.addOption(traceOption);
+  parser.addPositionalArgument(
+    "inputs", "Drawings or wildcard patterns", "inputs...");
+  parser.process(app);
+
+  QTextStream out{stdout};
+  QTextStream err{stderr};
+
+  Options options{};
+  options.outputDir = parser.value(outputOption);
+
+  const QString format{parser.value(formatOption).toLower()};
+  if (format == "png")
+  {
+    options.format = Format::Png;
+  }
+  else if (format == "jpeg" || format == "jpg")
+  {
+    options.format = Format::Jpeg;
+  }
+  else if (format == "raw")
+  {
+    options.format = Format::Raw;
+  }
+  else
+  {
+    err << "Unknown format " << format << "\n";
+    return 2;
+  }
+
+  bool valid{true};
+  if (parser.isSet(sizeOption))
+  {
+    const QStringList parts{parser.value(sizeOption).split('x')};
+    bool widthOk{false};
+    bool heightOk{false};
+    if (parts.size() == 2)
+    {
+      options.size = QSize{
+        parts.at(0).toInt(&widthOk), parts.at(1).toInt(&heightOk)};
+    }
+    valid = widthOk && heightOk && !options.size.isEmpty();
+  }
+  bool scaleOk{false};
+  options.scale = parser.value(scaleOption).toDouble(&scaleOk);
+  bool qualityOk{false};
+  options.quality = parser.value(qualityOption).toInt(&qualityOk);
+  bool jobsOk{false};
+  options.jobs = parser.value(jobsOption).toInt(&jobsOk);
+  if (
+    !valid || !scaleOk || options.scale <= 0.0 || !qualityOk || !jobsOk ||
+    options.jobs < 0)
+  {
+    err << "Invalid option value\n" << parser.helpText();
+    return 2;
+  }
+
+  options.inputs = expandInputs(parser.positionalArguments());
+  if (options.inputs.isEmpty())
+  {
+    err << "No inputs\n" << parser.helpText();
+    return 2;
+  }
+  if (!options.outputDir.isEmpty() && !QDir{}.mkpath(options.outputDir))
+  {
+    err << "Cannot create " << options.outputDir << "\n";
+    return 2;
+  }
+
+  // Outputs are named after the input alone, files of the same name from
+  // different directories would overwrite each other in parallel
+  QHash<QString, QString> outputs{};
+  for (const QString& input : options.inputs)
+  {
+    const QString output{
+      QFileInfo{outputPath(input, options)}.absoluteFilePath()};
+    const auto taken{outputs.constFind(output)};
+    if (taken != outputs.cend())
+    {
+      err << taken.value() << " and " << input << " would both be written to "
+          << output << ", render them into different directories with -o\n";
+      return 2;
+    }
+    outputs.insert(output, input);
+  }
+
+  // Files run on their own pool, the tiles of each still spread over the
+  // global one
+  QThreadPool pool{};
+  pool.setMaxThreadCount(
+    options.jobs > 0 ? options.jobs : QThread::idealThreadCount());
+
+  QElapsedTimer wall{};
+  wall.start();
+  QVector<QFuture<Result>> futures{};
+  std::ranges::for_each(
+    options.inputs,
+    [&futures, &pool, &options](const QString& input)
+    {
+      futures.push_back(
+        QtConcurrent::run(&pool, &BatchRenderer::render, input, options));
+    });
+
+  out << "load_ms\trender_ms\twrite_ms\tshapes\tsize\tinput\toutput\n";
+  int failed{0};
+  std::ranges::for_each(
+    futures,
+    [&out, &err, &failed](QFuture<Result>& future)
+    {
+      const Result result{future.result()};
+      if (!result.error.isEmpty())
+      {
+        ++failed;
+        err << result.input << ": " << result.error << "\n";
+        return;
+      }
+      out << milliseconds(result.loadNs) << '\t'
+          << milliseconds(result.renderNs) << '\t'
+          << milliseconds(result.writeNs) << '\t' << result.shapeCount << '\t'
+          << result.size.width() << 'x' << result.size.height() << '\t'
+          << result.input << '\t' << result.output << "\n";
+    });
+
+  out << "# " << options.inputs.size() << " files, " << failed
+      << " failed, " << milliseconds(wall.nsecsElapsed()) << " ms\n";
+  return failed == 0 ? 0 : 1;
+}
+
+QStringList BatchRenderer::expandInputs(const QStringList& patterns)
+{
+  QStringList inputs{};
+  std::ranges::for_each(
+    patterns,
+    [&inputs](const QString& pattern)
+    {
+      const QFileInfo info{pattern};
+      if (!info.fileName().contains(QRegularExpression{"[*?\\[]"}))
+      {
+        // Missing files are reported by the file, not dropped here
+        inputs.push_back(pattern);
+        return;
+      }
+      const QDir dir{info.path()};
+      std::ranges::for_each(
+        dir.entryList(QStringList{info.fileName()}, QDir::Files, QDir::Name),
+        [&inputs, &dir](const QString& name)
+        {
+          inputs.push_back(dir.filePath(name));
+        });
+    });
+  return inputs;
+}
+
+BatchRenderer::Result
+BatchRenderer::render(const QString& input, const Options& options)
+{
+  const TraceSpan span{"render file", "worker"};
+  Result result{};
+  result.input = input;
+  result.output = outputPath(input, options);
+
+  QElapsedTimer timer{};
+  timer.start();
+  SceneSnapshot snapshot{};
+  if (!snapshot.load(input))
+  {
+    result.error = "cannot load the scene";
+    return result;
+  }
+  result.loadNs = timer.nsecsElapsed();
+  result.shapeCount = snapshot.shapes.size();
+
+  qreal scale{options.scale};
+  if (!options.size.isEmpty())
+  {
+    scale = qMin(
+      options.size.width() / static_cast<qreal>(snapshot.size.width()),
+      options.size.height() / static_cast<qreal>(snapshot.size.height()));
+  }
+
+  timer.start();
+  const QImage img{snapshot.render(scale)};
+  result.renderNs = timer.nsecsElapsed();
+  if (img.isNull())
+  {
+    result.error = "cannot allocate the image";
+    return result;
+  }
+  result.size = img.size();
+
+  timer.start();
+  const TraceSpan encode{"encode image", "io"};
+  bool written{false};
+  if (options.format == Format::Raw)
+  {
+    written = writeRaw(result.output, img);
+  }
+  else
+  {
+    QImageWriter writer{
+      result.output, options.format == Format::Png ? "png" : "jpeg"};
+    writer.setQuality(options.quality);
+    written = writer.write(img);
+  }
+  result.writeNs = timer.nsecsElapsed();
+  if (!written)
+  {
+    result.error = "cannot write " + result.output;
+  }
+  return result;
+}
+
+QString BatchRenderer::outputPath(const QString& input, const Options& options)
+{
+  const QFileInfo info{input};
+  const QString suffix{
+    options.format == Format::Png    ? "png"
+    : options.format == Format::Jpeg ? "jpg"
+                                     : "raw"};
+  const QDir dir{
+    options.outputDir.isEmpty() ? QDir::currentPath() : options.outputDir};
+
+  QString path{
+    dir.filePath(QString{"%1.%2"}.arg(info.completeBaseName(), suffix))};
+  if (QFileInfo{path}.absoluteFilePath() == info.absoluteFilePath())
+  {
+    // Never replace the drawing itself
+    path = dir.filePath(
+      QString{"%1-render.%2"}.arg(info.completeBaseName(), suffix));
+  }
+  return path;
+}
+
+bool BatchRenderer::writeRaw(const QString& path, const QImage& img)
+{
+  // Rows are four bytes per pixel and never padded in this format
+  QSaveFile file{path};
+  return file.open(QIODevice::WriteOnly) &&
+         file.write(
+           reinterpret_cast<const char*>(img.constBits()),
+           img.sizeInBytes()) == img.sizeInBytes() &&
+         file.commit();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+// Renders saved drawings without a window, for batch jobs:
+//   qt-shapes-drawing-app --render [options] inputs...
+// Inputs are drawings (PNG with the scene chunks, .qshapes or JSON scenes)
+// or wildcard patterns naming them. Each one is loaded into its own
+// SceneSnapshot and rendered on a worker of a dedicated pool, then written
+// as PNG, JPEG or raw premultiplied ARGB32 pixels, named after the input
+// without its directory. Inputs whose outputs would collide are refused
+// before anything is rendered. A line with the timings of every file goes
+// to standard output.
+class BatchRenderer
+{
+public:
+  static constexpr const char* switchName{"--render"};
+
+  enum class Format
+  {
+    Png,
+    Jpeg,
+    Raw,
+  };
+
+  struct Options
+  {
+    QStringList inputs{};
+    QString outputDir{};
+    Format format{Format::Png};
+    // Fit into this size keeping the aspect ratio, scale is used if empty
+    QSize size{};
+    qreal scale{1.0};
+    int quality{-1};
+    int jobs{0};
+  };
+
+  struct Result
+  {
+    QString input{};
+    QString output{};
+    QSize size{};
+    qsizetype shapeCount{0};
+    qint64 loadNs{0};
+    qint64 renderNs{0};
+    qint64 writeNs{0};
+    QString error{};
+  };
+
+  // Whether the command line asks for batch rendering instead of the app
+  static bool isRequested(const int argc, char* argv[]);
+  // Runs the batch on the offscreen platform, returns the exit code
+  static int run(int argc, char* argv[]);
+
+  // Files matching the patterns, in the order given, sorted per pattern
+  static QStringList expandInputs(const QStringList& patterns);
+  static Result render(const QString& input, const Options& options);
+
+private:
+  static QString outputPath(const QString& input, const Options& options);
+  static bool writeRaw(const QString& path, const QImage& img);
+};
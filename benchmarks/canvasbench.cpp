@@ -0,0 +1,344 @@
+// Qt Test benchmarks of the canvas hot paths. Every function runs on
+// synthetic scenes of 1k, 10k, 100k and 1M shapes filling a full HD
+// canvas. Sizes, functions and the output format are picked with the usual
+// Qt Test arguments, for example:
+//   canvasbench -platform offscreen -csv
+//   canvasbench -platform offscreen -o results.xml,xml topHit:100k
+
+#include "allocationcounter.hpp"
+#include "paintcanvas.hpp"
+#include "scenegenerator.hpp"
+
+#include <QImage>
+#include <QRandomGenerator>
+#include <QTest>
+
+// C++ standard
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <ranges>
+#include <utility>
+
+namespace
+{
+const QSize viewport{1920, 1080};
+// Calls per iteration of the point query benchmarks
+constexpr int samples{1000};
+} // namespace
+
+class CanvasBench : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase_data();
+  void init();
+
+  void shapePath();
+  void hitTest();
+  void topHit();
+  void applySelectionRect();
+  void moveSelected();
+  void rotateSelected();
+  void cloneSelected();
+  void toSerialized();
+  void loadFromSerialized();
+  void toImage();
+  void paintEvent();
+  void paintEventAllocations();
+
+private:
+  // Built once per size and kept, the benchmarks leave them as they were
+  std::map<int, std::unique_ptr<PaintCanvas>> canvases{};
+  PaintCanvas* canvas{nullptr};
+
+  PaintCanvas& scene(const int count);
+  QVector<int> everyNth(const int n) const;
+  void select(const QVector<int>& indices);
+};
+
+void CanvasBench::initTestCase_data()
+{
+  QTest::addColumn<int>("shapes");
+  QTest::newRow("1k") << 1000;
+  QTest::newRow("10k") << 10000;
+  QTest::newRow("100k") << 100000;
+  QTest::newRow("1M") << 1000000;
+}
+
+void CanvasBench::init()
+{
+  QFETCH_GLOBAL(int, shapes);
+  this->canvas = &this->scene(shapes);
+  this->canvas->clearSelections();
+}
+
+PaintCanvas& CanvasBench::scene(const int count)
+{
+  std::unique_ptr<PaintCanvas>& canvas{this->canvases[count]};
+  if (!canvas)
+  {
+    canvas = std::make_unique<PaintCanvas>();
+    canvas->setAttribute(Qt::WA_DontShowOnScreen);
+    canvas->resize(viewport);
+    canvas->show();
+    // Edits made here are never undone, keep no history
+    canvas->setUndoMemoryLimit(0);
+    canvas->loadFromBinary(SceneCodec::toCbor(
+      makeScene(count, QSizeF{viewport}), canvas->sceneSettings()));
+  }
+  return *canvas;
+}
+
+QVector<int> CanvasBench::everyNth(const int n) const
+{
+  QVector<int> indices{};
+  for (int i{0}; i < this->canvas->shapes.size(); i += n)
+  {
+    indices.push_back(i);
+  }
+  return indices;
+}
+
+void CanvasBench::select(const QVector<int>& indices)
+{
+  std::ranges::for_each(
+    indices,
+    [this](const int i)
+    {
+      this->canvas->shapes.setSelected(i, true);
+    });
+}
+
+void CanvasBench::shapePath()
+{
+  // Cold: moving by nothing drops every cached path
+  const QVector<int> all{this->everyNth(1)};
+  QBENCHMARK
+  {
+    this->canvas->shapes.translate(all, QPointF{});
+    std::ranges::for_each(
+      all,
+      [this](const int i)
+      {
+        this->canvas->shapePath(i);
+      });
+  }
+}
+
+void CanvasBench::hitTest()
+{
+  // Each shape tested at a point near its center
+  QRandomGenerator rng{11};
+  QVector<std::pair<int, QPointF>> probes{};
+  for (int k{0}; k < samples; ++k)
+  {
+    const int i{rng.bounded(static_cast<int>(this->canvas->shapes.size()))};
+    probes.push_back(
+      {i,
+       this->canvas->shapeCenter(i) +
+         QPointF{rng.bounded(8.0) - 4.0, rng.bounded(8.0) - 4.0}});
+  }
+
+  int hits{0};
+  QBENCHMARK
+  {
+    std::ranges::for_each(
+      probes,
+      [this, &hits](const std::pair<int, QPointF>& probe)
+      {
+        hits += this->canvas->hitTest(probe.first, probe.second) ? 1 : 0;
+      });
+  }
+
+  // Centers of rectangles and ellipses and centroids of triangles are
+  // inside, every shape has to be hit there
+  const auto centerHits{std::ranges::count_if(
+    probes,
+    [this](const std::pair<int, QPointF>& probe)
+    {
+      return this->canvas->hitTest(
+        probe.first, this->canvas->shapeCenter(probe.first));
+    })};
+  QCOMPARE(centerHits, probes.size());
+}
+
+void CanvasBench::topHit()
+{
+  QRandomGenerator rng{13};
+  QVector<QPointF> points{};
+  for (int k{0}; k < samples; ++k)
+  {
+    points.push_back(QPointF{
+      rng.bounded(static_cast<qreal>(viewport.width())),
+      rng.bounded(static_cast<qreal>(viewport.height()))});
+  }
+
+  int top{0};
+  QBENCHMARK
+  {
+    std::ranges::for_each(
+      points,
+      [this, &top](const QPointF& p)
+      {
+        top = qMax(top, this->canvas->topHit(p));
+      });
+  }
+
+  // A few points against a scan of every shape from the top down
+  std::ranges::for_each(
+    points | std::views::take(16),
+    [this](const QPointF& p)
+    {
+      int expected{static_cast<int>(this->canvas->shapes.size()) - 1};
+      while (expected >= 0 && !this->canvas->hitTest(expected, p))
+      {
+        --expected;
+      }
+      QCOMPARE(this->canvas->topHit(p), expected);
+    });
+}
+
+void CanvasBench::applySelectionRect()
+{
+  const QRectF rect{860.0, 440.0, 200.0, 200.0};
+  this->canvas->setSelectionRect(rect);
+  QBENCHMARK
+  {
+    this->canvas->applySelectionRect(false);
+  }
+  this->canvas->setSelectionRect(QRectF{});
+
+  // Every shape the rectangle touches or holds, found without the index
+  const auto expected{std::ranges::count_if(
+    std::views::iota(0, static_cast<int>(this->canvas->shapes.size())),
+    [this, &rect](const int i)
+    {
+      const QRectF bounds{this->canvas->shapeBounds(i)};
+      return rect.intersects(bounds) &&
+             (this->canvas->shapePath(i).intersects(rect) ||
+              rect.contains(bounds));
+    })};
+  QVERIFY(expected > 0);
+  QCOMPARE(this->canvas->shapes.selectionSize(), expected);
+}
+
+void CanvasBench::moveSelected()
+{
+  // One drag step and its release on a tenth of the scene. The direction
+  // flips every time so the scene stays where it was
+  this->select(this->everyNth(10));
+  qreal step{1.0};
+  QBENCHMARK
+  {
+    this->canvas->moveSelected(QPointF{step, 0.0});
+    this->canvas->commitPendingTransform();
+    step = -step;
+  }
+}
+
+void CanvasBench::rotateSelected()
+{
+  // Turning back and forth between the same two points
+  this->select(this->everyNth(10));
+  QPointF start{960.0, 0.0};
+  QPointF now{1060.0, 0.0};
+  QBENCHMARK
+  {
+    this->canvas->rotateSelected(start, now);
+    this->canvas->commitPendingTransform();
+    std::swap(start, now);
+  }
+}
+
+void CanvasBench::cloneSelected()
+{
+  // The clones are dropped again right away, removing the tail of the
+  // scene only touches the removed shapes
+  const QVector<int> originals{this->everyNth(100)};
+  const int count{static_cast<int>(this->canvas->shapes.size())};
+  SceneEdit drop{};
+  drop.kind = SceneEdit::Kind::Delete;
+  std::ranges::copy(
+    std::views::iota(count, count + static_cast<int>(originals.size())),
+    std::back_inserter(drop.indices));
+
+  QBENCHMARK
+  {
+    this->select(originals);
+    this->canvas->cloneSelected();
+    this->canvas->applyEdit(drop);
+  }
+  QCOMPARE(this->canvas->shapes.size(), qsizetype{count});
+}
+
+void CanvasBench::toSerialized()
+{
+  QString json{};
+  QBENCHMARK
+  {
+    json = this->canvas->toSerialized();
+  }
+  QVERIFY(!json.isEmpty());
+}
+
+void CanvasBench::loadFromSerialized()
+{
+  const QString json{this->canvas->toSerialized()};
+  const qsizetype count{this->canvas->shapes.size()};
+  QBENCHMARK
+  {
+    this->canvas->loadFromSerialized(json);
+  }
+  QCOMPARE(this->canvas->shapes.size(), count);
+}
+
+void CanvasBench::toImage()
+{
+  QImage img{};
+  QBENCHMARK
+  {
+    img = this->canvas->toImage();
+  }
+  QVERIFY(!img.isNull());
+}
+
+void CanvasBench::paintEvent()
+{
+  // The full repaint path, without the retained layer of a gesture or
+  // cached tiles
+  this->canvas->layerValid = false;
+  this->canvas->tileCache.clear();
+  QImage target{viewport, QImage::Format_ARGB32_Premultiplied};
+  QBENCHMARK
+  {
+    this->canvas->render(&target);
+  }
+
+  // The scene lies inside the viewport, no shape can be culled
+  const FrameStats::Frame& frame{this->canvas->stats.last()};
+  QCOMPARE(qsizetype{frame.drawn}, this->canvas->shapes.size());
+  QCOMPARE(frame.culled, 0);
+}
+
+void CanvasBench::paintEventAllocations()
+{
+  // Operator new calls of a frame after the first one, reported as events.
+  // Only the GUI thread is counted, the tiles the first frame requested may
+  // still be rendering
+  if (!AllocationCounter::enabled)
+  {
+    QSKIP("Built without SHAPES_COUNT_ALLOCATIONS");
+  }
+  this->canvas->layerValid = false;
+  QImage target{viewport, QImage::Format_ARGB32_Premultiplied};
+  this->canvas->render(&target);
+  this->canvas->render(&target);
+  QTest::setBenchmarkResult(
+    static_cast<qreal>(this->canvas->stats.last().allocations),
+    QTest::Events);
+}
+
+QTEST_MAIN(CanvasBench)
+#include "canvasbench.moc"
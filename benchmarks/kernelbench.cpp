@@ -0,0 +1,264 @@
+// Compares the batch geometry kernels against the per-shape lambdas they
+// replace. Run with an optional shape count, default 100000:
+//   kernelbench [shapes]
+
+#include "geometrykernels.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPainterPath>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QTextStream>
+#include <QTransform>
+#include <QVector>
+
+// C++ standard
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <ranges>
+
+namespace
+{
+constexpr int rounds{7};
+
+// Best of several rounds in milliseconds, the first round warms caches
+double measure(const std::function<void()>& work)
+{
+  double best{std::numeric_limits<double>::max()};
+  for (int r{0}; r < rounds; ++r)
+  {
+    QElapsedTimer timer{};
+    timer.start();
+    work();
+    best = std::min(best, timer.nsecsElapsed() / 1.0e6);
+  }
+  return best;
+}
+
+void report(
+  QTextStream& out,
+  const QString& name,
+  const QString& variant,
+  const double ms,
+  const double baseline)
+{
+  out << qSetFieldWidth(10) << Qt::left << name << qSetFieldWidth(12)
+      << variant << qSetFieldWidth(0) << Qt::right
+      << QString::number(ms, 'f', 3) << " ms  x"
+      << QString::number(baseline / ms, 'f', 1) << Qt::endl;
+}
+
+QVector<GeometryKernels::Isa> availableIsas()
+{
+  QVector<GeometryKernels::Isa> result{GeometryKernels::Isa::Scalar};
+  if (GeometryKernels::bestIsa() >= GeometryKernels::Isa::Sse2)
+  {
+    result.push_back(GeometryKernels::Isa::Sse2);
+  }
+  if (GeometryKernels::bestIsa() >= GeometryKernels::Isa::Avx2)
+  {
+    result.push_back(GeometryKernels::Isa::Avx2);
+  }
+  return result;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app{argc, argv};
+  QTextStream out{stdout};
+
+  const QStringList args{QCoreApplication::arguments()};
+  const int count{args.size() > 1 ? qMax(1, args.at(1).toInt()) : 100000};
+
+  QRandomGenerator rng{42};
+  const auto coord = [&rng]()
+  {
+    return rng.bounded(2000.0);
+  };
+
+  // Old layout: one heap allocated point list per shape
+  QVector<QVector<QPointF>> perShape(count);
+  // New layout: three inline points per shape, back to back
+  QVector<std::array<QPointF, 3>> packed(count);
+  QVector<qreal> cx(count);
+  QVector<qreal> cy(count);
+  QVector<qreal> hx(count);
+  QVector<qreal> hy(count);
+  QVector<qreal> cosA(count);
+  QVector<qreal> sinA(count);
+  QVector<qreal> round(count);
+  QVector<qreal> angles(count);
+
+  for (int i{0}; i < count; ++i)
+  {
+    const QPointF a{coord(), coord()};
+    const QPointF b{a + QPointF{rng.bounded(200.0), rng.bounded(200.0)}};
+    perShape[i] = {a, b};
+    packed[i] = {a, b, QPointF{}};
+    angles[i] = rng.bounded(2.0 * M_PI);
+    const QRectF r{QRectF{a, b}.normalized()};
+    cx[i] = r.center().x();
+    cy[i] = r.center().y();
+    hx[i] = r.width() / 2.0;
+    hy[i] = r.height() / 2.0;
+    cosA[i] = std::cos(angles[i]);
+    sinA[i] = std::sin(angles[i]);
+    round[i] = i % 2 == 0 ? 1.0 : 0.0;
+  }
+
+  out << count << " shapes, best ISA "
+      << GeometryKernels::isaName(GeometryKernels::bestIsa()) << Qt::endl;
+
+  const QPointF delta{0.5, -0.25};
+  qreal* const xy{reinterpret_cast<qreal*>(packed.data())};
+  const qsizetype points{3 * static_cast<qsizetype>(count)};
+
+  // Translate: the old moveSelected inner loop against the kernel
+  const double translateBase{measure(
+    [&perShape, &delta]()
+    {
+      std::ranges::for_each(
+        perShape,
+        [&delta](QVector<QPointF>& pts)
+        {
+          std::ranges::for_each(
+            pts,
+            [&delta](QPointF& p)
+            {
+              p += delta;
+            });
+        });
+    })};
+  report(out, "translate", "lambdas", translateBase, translateBase);
+
+  for (const GeometryKernels::Isa isa : availableIsas())
+  {
+    GeometryKernels::setActiveIsa(isa);
+    report(
+      out,
+      "translate",
+      GeometryKernels::isaName(isa),
+      measure(
+        [xy, points, &delta]()
+        {
+          GeometryKernels::translate(xy, points, delta);
+        }),
+      translateBase);
+  }
+
+  // Rotate about a pivot: QTransform per point against the kernel
+  const QPointF pivot{1000.0, 1000.0};
+  const qreal angle{0.01};
+  const double rotateBase{measure(
+    [&perShape, &pivot, angle]()
+    {
+      QTransform tr{};
+      tr.translate(pivot.x(), pivot.y());
+      tr.rotateRadians(angle);
+      tr.translate(-pivot.x(), -pivot.y());
+      std::ranges::for_each(
+        perShape,
+        [&tr](QVector<QPointF>& pts)
+        {
+          std::ranges::for_each(
+            pts,
+            [&tr](QPointF& p)
+            {
+              p = tr.map(p);
+            });
+        });
+    })};
+  report(out, "rotate", "QTransform", rotateBase, rotateBase);
+
+  for (const GeometryKernels::Isa isa : availableIsas())
+  {
+    GeometryKernels::setActiveIsa(isa);
+    report(
+      out,
+      "rotate",
+      GeometryKernels::isaName(isa),
+      measure(
+        [xy, points, &pivot, angle]()
+        {
+          GeometryKernels::rotate(xy, points, pivot, angle);
+        }),
+      rotateBase);
+  }
+
+  // Rotated bounds: building the turned path as the old geometry cache did
+  // against the box kernel over prepared columns
+  QVector<QRectF> pathBounds(count);
+  const double boundsBase{measure(
+    [&perShape, &angles, &round, &pathBounds, count]()
+    {
+      for (int i{0}; i < count; ++i)
+      {
+        const QRectF r{
+          QRectF{perShape.at(i).at(0), perShape.at(i).at(1)}.normalized()};
+        QPainterPath path{};
+        if (round.at(i) != 0.0)
+        {
+          path.addEllipse(r);
+        }
+        else
+        {
+          path.addRect(r);
+        }
+        QTransform tr{};
+        tr.translate(r.center().x(), r.center().y());
+        tr.rotateRadians(angles.at(i));
+        tr.translate(-r.center().x(), -r.center().y());
+        pathBounds[i] = tr.map(path).boundingRect();
+      }
+    })};
+  report(out, "bounds", "QPainterPath", boundsBase, boundsBase);
+
+  QVector<qreal> bounds(4 * count);
+  const GeometryKernels::Boxes boxes{
+    cx.constData(),
+    cy.constData(),
+    hx.constData(),
+    hy.constData(),
+    cosA.constData(),
+    sinA.constData(),
+    round.constData()};
+  const GeometryKernels::Bounds target{
+    bounds.data(),
+    bounds.data() + count,
+    bounds.data() + 2 * count,
+    bounds.data() + 3 * count};
+
+  for (const GeometryKernels::Isa isa : availableIsas())
+  {
+    GeometryKernels::setActiveIsa(isa);
+    report(
+      out,
+      "bounds",
+      GeometryKernels::isaName(isa),
+      measure(
+        [&boxes, &target, count]()
+        {
+          GeometryKernels::rotatedBounds(boxes, count, target);
+        }),
+      boundsBase);
+  }
+
+  // Ellipse paths are bezier approximations, so only rectangles are
+  // expected to agree to rounding
+  qreal worst{0.0};
+  for (int i{1}; i < count; i += 2)
+  {
+    worst = std::max(
+      {worst,
+       std::abs(pathBounds.at(i).left() - bounds.at(i)),
+       std::abs(pathBounds.at(i).right() - bounds.at(2 * count + i))});
+  }
+  out << "largest rectangle bounds difference " << worst << Qt::endl;
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Size and parse time of the JSON and CBOR scene encodings and of the
+// mapped scene file. Run with an optional shape count, default 100000:
+//   scenebench [shapes]
+
+#include "scenecodec.hpp"
+#include "scenefile.hpp"
+#include "scenegenerator.hpp"
+#include "shapestore.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+// C++ standard
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+namespace
+{
+constexpr int rounds{5};
+
+double measure(const std::function<void()>& work)
+{
+  double best{std::numeric_limits<double>::max()};
+  for (int r{0}; r < rounds; ++r)
+  {
+    QElapsedTimer timer{};
+    timer.start();
+    work();
+    best = std::min(best, timer.nsecsElapsed() / 1.0e6);
+  }
+  return best;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app{argc, argv};
+  QTextStream out{stdout};
+
+  const QStringList args{QCoreApplication::arguments()};
+  const int count{args.size() > 1 ? qMax(1, args.at(1).toInt()) : 100000};
+
+  const ShapeStore scene{makeScene(count)};
+  const SceneCodec::Settings settings{};
+
+  QString json{};
+  QByteArray cbor{};
+  const double jsonWrite{measure(
+    [&scene, &settings, &json]()
+    {
+      json = SceneCodec::toJson(scene, settings);
+    })};
+  const double cborWrite{measure(
+    [&scene, &settings, &cbor]()
+    {
+      cbor = SceneCodec::toCbor(scene, settings);
+    })};
+
+  const double jsonRead{measure(
+    [&json]()
+    {
+      ShapeStore store{};
+      SceneCodec::Settings loaded{};
+      SceneCodec::fromJson(json, store, loaded);
+    })};
+  const double cborRead{measure(
+    [&cbor]()
+    {
+      ShapeStore store{};
+      SceneCodec::Settings loaded{};
+      SceneCodec::fromCbor(cbor, store, loaded);
+    })};
+
+  // Opening maps the file; drawing one shape then faults in only its pages
+  const QTemporaryDir dir{};
+  const QString path{
+    dir.filePath(QStringLiteral("bench.%1").arg(SceneFile::suffix))};
+  const double fileWrite{measure(
+    [&scene, &settings, &path]()
+    {
+      SceneFile::save(path, scene, settings);
+    })};
+  const double fileOpen{measure(
+    [&path]()
+    {
+      ShapeStore store{};
+      SceneCodec::Settings loaded{};
+      SceneFile::open(path, store, loaded);
+      store.path(static_cast<int>(store.size() / 2));
+    })};
+
+  const qsizetype jsonBytes{json.toUtf8().size()};
+  const qsizetype base64Bytes{cbor.toBase64().size()};
+
+  out << count << " shapes" << Qt::endl;
+  out << "JSON  " << jsonBytes << " bytes, write " << jsonWrite
+      << " ms, read " << jsonRead << " ms" << Qt::endl;
+  out << "CBOR  " << cbor.size() << " bytes (" << base64Bytes
+      << " as base64 text chunk), write " << cborWrite << " ms, read "
+      << cborRead << " ms" << Qt::endl;
+  out << "size x" << QString::number(double(jsonBytes) / base64Bytes, 'f', 1)
+      << " smaller in the PNG, read x"
+      << QString::number(jsonRead / cborRead, 'f', 1) << " faster"
+      << Qt::endl;
+  out << "file  " << QFileInfo{path}.size() << " bytes, write " << fileWrite
+      << " ms, open " << fileOpen << " ms" << Qt::endl;
+
+  return 0;
+}
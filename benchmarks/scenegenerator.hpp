@@ -0,0 +1,46 @@
+#pragma once
+
+#include "shapestore.hpp"
+
+#include <QRandomGenerator>
+#include <QSizeF>
+
+// C++ standard
+#include <algorithm>
+#include <cmath>
+
+// Deterministic synthetic scene for the benchmarks: count shapes of mixed
+// types, rotations and styles scattered over area. Shapes shrink as the
+// count grows, so every scene covers the area about twice over
+inline ShapeStore makeScene(
+  const int count, const QSizeF& area = QSizeF{4000.0, 4000.0})
+{
+  QRandomGenerator rng{7};
+  const QColor palette[]{Qt::black, Qt::red, Qt::darkGreen, Qt::blue};
+  const qreal extent{std::clamp(
+    2.0 * std::sqrt(area.width() * area.height() / qMax(1, count)),
+    4.0,
+    64.0)};
+
+  ShapeStore store{};
+  store.reserve(count);
+  for (int i{0}; i < count; ++i)
+  {
+    Shape s{};
+    s.type = static_cast<ShapeType>(rng.bounded(1, 5));
+    const QPointF center{
+      rng.bounded(area.width()), rng.bounded(area.height())};
+    for (QPointF& p : s.points)
+    {
+      p = center + QPointF{
+                     rng.bounded(extent) - extent / 2.0,
+                     rng.bounded(extent) - extent / 2.0};
+    }
+    s.rotation = rng.bounded(6.28);
+    // Styles change in runs, as when drawing by hand
+    s.style.pen = palette[(i / 50) % 4];
+    s.style.width = 1 + (i / 200) % 8;
+    store.append(s);
+  }
+  return store;
+}
@@ -0,0 +1,202 @@
+// Replays an input trace recorded with --record-trace against a drawing,
+// through the event handlers and the paint path of a real canvas on the
+// offscreen platform. Prints percentiles of the handler time per event
+// kind, of the paint that follows and of both together:
+//   tracereplay trace [drawing] [repeats]
+// SHAPES_TRACE_EVENTS=file also writes the spans of the replay.
+
+#include "inputtrace.hpp"
+#include "paintcanvas.hpp"
+#include "scenefile.hpp"
+#include "traceevents.hpp"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QStringList>
+#include <QTextStream>
+
+// C++ standard
+#include <algorithm>
+#include <cmath>
+#include <ranges>
+
+namespace
+{
+struct Samples
+{
+  QString name{};
+  QVector<qint64> ns{};
+};
+
+// Nearest rank on sorted samples
+double percentile(const QVector<qint64>& sorted, const double p)
+{
+  if (sorted.isEmpty())
+  {
+    return 0.0;
+  }
+  const qsizetype rank{static_cast<qsizetype>(
+    std::ceil(p / 100.0 * static_cast<double>(sorted.size())))};
+  return sorted.at(std::clamp(rank - 1, qsizetype{0}, sorted.size() - 1)) /
+         1.0e6;
+}
+
+// Tells whether handling an event led to a repaint
+class PaintCounter : public QObject
+{
+public:
+  int paints{0};
+
+protected:
+  bool eventFilter(QObject* watched, QEvent* event) override
+  {
+    if (event->type() == QEvent::Paint)
+    {
+      ++this->paints;
+    }
+    return QObject::eventFilter(watched, event);
+  }
+};
+
+bool loadDrawing(PaintCanvas& canvas, const QString& path)
+{
+  if (SceneFile::isSceneFile(path))
+  {
+    return canvas.openSceneFile(path);
+  }
+  if (QFileInfo{path}.suffix().compare("json", Qt::CaseInsensitive) == 0)
+  {
+    QFile file{path};
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      return false;
+    }
+    canvas.loadFromSerialized(QString::fromUtf8(file.readAll()));
+    return true;
+  }
+  const QImage img{path};
+  if (img.isNull())
+  {
+    return false;
+  }
+  canvas.loadFromImage(img);
+  return true;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication app{argc, argv};
+  if (qEnvironmentVariableIsSet(TraceEvents::environmentName))
+  {
+    TraceEvents::start(qEnvironmentVariable(TraceEvents::environmentName));
+  }
+  QTextStream out{stdout};
+  QTextStream err{stderr};
+
+  const QStringList args{QCoreApplication::arguments()};
+  if (args.size() < 2)
+  {
+    err << "Usage: tracereplay trace [drawing] [repeats]\n";
+    return 2;
+  }
+
+  InputTrace trace{};
+  if (!trace.load(args.at(1)))
+  {
+    err << "Cannot read the trace " << args.at(1) << "\n";
+    return 2;
+  }
+  const QString drawing{args.size() > 2 ? args.at(2) : QString{}};
+  const int repeats{args.size() > 3 ? qMax(1, args.at(3).toInt()) : 1};
+
+  PaintCanvas canvas{};
+  canvas.resize(
+    trace.getCanvasSize().isEmpty() ? QSize{1280, 800}
+                                    : trace.getCanvasSize());
+  canvas.show();
+  PaintCounter counter{};
+  canvas.installEventFilter(&counter);
+
+  Samples press{"press"};
+  Samples move{"move"};
+  Samples release{"release"};
+  Samples key{"key"};
+  Samples frame{"frame"};
+  Samples latency{"event+frame"};
+
+  for (int r{0}; r < repeats; ++r)
+  {
+    // Every repeat starts from the same scene, loading is not timed
+    if (drawing.isEmpty())
+    {
+      canvas.clearAll();
+    }
+    else if (!loadDrawing(canvas, drawing))
+    {
+      err << "Cannot load the drawing " << drawing << "\n";
+      return 2;
+    }
+    QCoreApplication::processEvents();
+
+    std::ranges::for_each(
+      trace.events(),
+      [&canvas, &counter, &press, &move, &release, &key, &frame, &latency](
+        const InputTrace::Event& event)
+      {
+        if (canvas.getTool() != event.tool)
+        {
+          canvas.setTool(event.tool);
+          QCoreApplication::processEvents();
+        }
+
+        const std::unique_ptr<QInputEvent> input{
+          InputTrace::toInputEvent(event)};
+        QElapsedTimer timer{};
+        timer.start();
+        QCoreApplication::sendEvent(&canvas, input.get());
+        const qint64 handled{timer.nsecsElapsed()};
+
+        // Delivers the update requests the handler posted, which paints
+        counter.paints = 0;
+        timer.start();
+        QCoreApplication::processEvents();
+        const qint64 painted{timer.nsecsElapsed()};
+
+        Samples& kind{
+          event.type == InputTrace::Event::Type::Press  ? press
+          : event.type == InputTrace::Event::Type::Move ? move
+          : event.type == InputTrace::Event::Type::Release
+            ? release
+            : key};
+        kind.ns.push_back(handled);
+        if (counter.paints > 0)
+        {
+          frame.ns.push_back(painted);
+          latency.ns.push_back(handled + painted);
+        }
+      });
+  }
+
+  out << "kind\tcount\tp50_ms\tp95_ms\tp99_ms\tmax_ms\n";
+  std::ranges::for_each(
+    QVector<Samples*>{&press, &move, &release, &key, &frame, &latency},
+    [&out](Samples* const samples)
+    {
+      std::ranges::sort(samples->ns);
+      out << samples->name << '\t' << samples->ns.size() << '\t'
+          << QString::number(percentile(samples->ns, 50.0), 'f', 3) << '\t'
+          << QString::number(percentile(samples->ns, 95.0), 'f', 3) << '\t'
+          << QString::number(percentile(samples->ns, 99.0), 'f', 3) << '\t'
+          << QString::number(percentile(samples->ns, 100.0), 'f', 3) << '\n';
+    });
+  TraceEvents::stop();
+  return 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <QVector>
+
+// One array of the shape store. It either owns its elements or views memory
+// owned elsewhere, typically a mapped scene file. Reads go through a plain
+// pointer either way; the first write to a viewed column copies it.
+template <typename T>
+class Column
+{
+public:
+  Column() = default;
+
+  Column(const Column& other)
+    : owned{other.owned}, viewed{other.viewed}, items{other.items},
+      count{other.count}
+  {
+    this->refresh();
+  }
+
+  Column& operator=(const Column& other)
+  {
+    this->owned = other.owned;
+    this->viewed = other.viewed;
+    this->items = other.items;
+    this->count = other.count;
+    this->refresh();
+    return *this;
+  }
+
+  qsizetype size() const
+  {
+    return this->count;
+  }
+
+  bool isEmpty() const
+  {
+    return this->count == 0;
+  }
+
+  bool isView() const
+  {
+    return this->viewed;
+  }
+
+  const T& at(const qsizetype i) const
+  {
+    Q_ASSERT(i >= 0 && i < this->count);
+    return this->items[i];
+  }
+
+  T& operator[](const qsizetype i)
+  {
+    this->detach();
+    return this->owned[i];
+  }
+
+  const T* constData() const
+  {
+    return this->items;
+  }
+
+  T* data()
+  {
+    this->detach();
+    return this->owned.data();
+  }
+
+  const T* begin() const
+  {
+    return this->items;
+  }
+
+  const T* end() const
+  {
+    return this->items + this->count;
+  }
+
+  void push_back(const T& value)
+  {
+    this->detach();
+    this->owned.push_back(value);
+    this->refresh();
+  }
+
+  void resize(const qsizetype n)
+  {
+    this->detach();
+    this->owned.resize(n);
+    this->refresh();
+  }
+
+  void reserve(const qsizetype n)
+  {
+    this->detach();
+    this->owned.reserve(n);
+    this->refresh();
+  }
+
+  void clear()
+  {
+    this->owned.clear();
+    this->viewed = false;
+    this->refresh();
+  }
+
+  // Heap bytes held by the column, a view costs nothing
+  qsizetype capacity() const
+  {
+    return this->viewed ? 0 : this->owned.capacity();
+  }
+
+  // The memory has to outlive this column and every copy of it
+  void setView(const T* const data, const qsizetype n)
+  {
+    this->owned.clear();
+    this->viewed = true;
+    this->items = data;
+    this->count = n;
+  }
+
+  // Makes the elements private to this column so they can be written
+  void detach()
+  {
+    if (this->viewed)
+    {
+      this->owned = QVector<T>(this->items, this->items + this->count);
+      this->viewed = false;
+    }
+    this->owned.detach();
+    this->refresh();
+  }
+
+private:
+  QVector<T> owned{};
+  bool viewed{false};
+  const T* items{nullptr};
+  qsizetype count{0};
+
+  void refresh()
+  {
+    if (!this->viewed)
+    {
+      this->items = this->owned.constData();
+      this->count = this->owned.size();
+    }
+  }
+};
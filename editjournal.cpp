@@ -0,0 +1,520 @@
+#include "editjournal.hpp"
+
+#include <QDataStream>
+#include <QFileInfo>
+#include <QSaveFile>
+
+// C++ standard
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <utility>
+
+namespace
+{
+constexpr char magic[8]{'Q', 'S', 'H', 'P', 'J', 'R', 'N', '\0'};
+// Kind, payload length and checksum in front of every payload
+constexpr qsizetype recordHeaderSize{
+  sizeof(quint8) + sizeof(quint32) + sizeof(quint16)};
+// Far beyond any real edit, larger values mean a damaged record
+constexpr quint32 maxPayload{1u << 30};
+constexpr quint32 maxPositions{1u << 26};
+
+void prepare(QDataStream& stream)
+{
+  stream.setVersion(QDataStream::Qt_6_0);
+  stream.setByteOrder(QDataStream::LittleEndian);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+// Positions are stored as runs of consecutive values, which is what
+// selections, clones and freshly drawn shapes mostly are
+void writeIndices(QDataStream& out, const QVector<int>& indices)
+{
+  QVector<std::pair<qint32, qint32>> runs{};
+  std::ranges::for_each(
+    indices,
+    [&runs](const int i)
+    {
+      if (!runs.isEmpty() && runs.last().first + runs.last().second == i)
+      {
+        ++runs.last().second;
+      }
+      else
+      {
+        runs.push_back({i, 1});
+      }
+    });
+
+  out << static_cast<quint32>(runs.size());
+  std::ranges::for_each(
+    runs,
+    [&out](const std::pair<qint32, qint32>& run)
+    {
+      out << run.first << run.second;
+    });
+}
+
+std::optional<QVector<int>> readIndices(QDataStream& in)
+{
+  quint32 runCount{0};
+  in >> runCount;
+  if (runCount > maxPositions)
+  {
+    return std::nullopt;
+  }
+
+  QVector<int> indices{};
+  for (quint32 r{0}; r < runCount && in.status() == QDataStream::Ok; ++r)
+  {
+    qint32 first{0};
+    qint32 length{0};
+    in >> first >> length;
+    if (
+      first < 0 || length <= 0 ||
+      length > std::numeric_limits<qint32>::max() - first ||
+      static_cast<quint32>(indices.size()) + length > maxPositions)
+    {
+      return std::nullopt;
+    }
+    std::ranges::copy(
+      std::views::iota(first, first + length),
+      std::back_inserter(indices));
+  }
+  return indices;
+}
+
+void writeStyle(QDataStream& out, const ShapeStyle& style)
+{
+  out << static_cast<quint32>(style.pen.rgba())
+      << static_cast<quint32>(style.fill.rgba())
+      << static_cast<qint32>(style.width);
+}
+
+ShapeStyle readStyle(QDataStream& in)
+{
+  quint32 pen{0};
+  quint32 fill{0};
+  qint32 width{0};
+  in >> pen >> fill >> width;
+
+  ShapeStyle style{};
+  style.pen = QColor::fromRgba(pen);
+  style.fill = QColor::fromRgba(fill);
+  style.width = width;
+  return style;
+}
+
+void writeShape(QDataStream& out, const Shape& shape)
+{
+  out << static_cast<quint8>(shape.type) << shape.rotation;
+  std::ranges::for_each(
+    shape.points | std::views::take(ShapeStore::pointCountOf(shape.type)),
+    [&out](const QPointF& p)
+    {
+      out << p.x() << p.y();
+    });
+  writeStyle(out, shape.style);
+}
+
+std::optional<Shape> readShape(QDataStream& in)
+{
+  Shape shape{};
+  quint8 type{0};
+  in >> type >> shape.rotation;
+  if (
+    type < static_cast<quint8>(ShapeType::Square) ||
+    type > static_cast<quint8>(ShapeType::Ellipse))
+  {
+    return std::nullopt;
+  }
+  shape.type = static_cast<ShapeType>(type);
+  std::ranges::for_each(
+    shape.points | std::views::take(ShapeStore::pointCountOf(shape.type)),
+    [&in](QPointF& p)
+    {
+      qreal x{0.0};
+      qreal y{0.0};
+      in >> x >> y;
+      p = QPointF{x, y};
+    });
+  shape.style = readStyle(in);
+  return shape;
+}
+
+QByteArray encodePayload(const SceneEdit& edit)
+{
+  QByteArray payload{};
+  QDataStream out{&payload, QIODevice::WriteOnly};
+  prepare(out);
+
+  switch (edit.kind)
+  {
+  case SceneEdit::Kind::Clear:
+    break;
+  case SceneEdit::Kind::Create:
+    writeShape(out, edit.shape);
+    break;
+  case SceneEdit::Kind::Transform:
+    writeIndices(out, edit.indices);
+    out << edit.offset.x() << edit.offset.y() << edit.rotation;
+    break;
+  case SceneEdit::Kind::Clone:
+  case SceneEdit::Kind::Delete:
+    writeIndices(out, edit.indices);
+    break;
+  case SceneEdit::Kind::Insert:
+    writeIndices(out, edit.indices);
+    out << static_cast<quint32>(edit.shapes.size());
+    std::ranges::for_each(
+      edit.shapes,
+      [&out](const Shape& shape)
+      {
+        writeShape(out, shape);
+      });
+    break;
+  case SceneEdit::Kind::Settings:
+    out << static_cast<quint8>(edit.settings.fill ? 1 : 0);
+    writeStyle(
+      out,
+      ShapeStyle{
+        edit.settings.penColor,
+        edit.settings.fillColor,
+        edit.settings.penWidth});
+    break;
+  }
+  return payload;
+}
+
+std::optional<SceneEdit>
+decodePayload(const quint8 kind, const QByteArray& payload)
+{
+  QDataStream in{payload};
+  prepare(in);
+
+  SceneEdit edit{};
+  edit.kind = static_cast<SceneEdit::Kind>(kind);
+
+  switch (edit.kind)
+  {
+  case SceneEdit::Kind::Clear:
+    break;
+  case SceneEdit::Kind::Create:
+  {
+    std::optional<Shape> shape{readShape(in)};
+    if (!shape.has_value())
+    {
+      return std::nullopt;
+    }
+    edit.shape = *shape;
+    break;
+  }
+  case SceneEdit::Kind::Transform:
+  {
+    std::optional<QVector<int>> indices{readIndices(in)};
+    if (!indices.has_value())
+    {
+      return std::nullopt;
+    }
+    edit.indices = std::move(*indices);
+    qreal dx{0.0};
+    qreal dy{0.0};
+    in >> dx >> dy >> edit.rotation;
+    edit.offset = QPointF{dx, dy};
+    break;
+  }
+  case SceneEdit::Kind::Clone:
+  case SceneEdit::Kind::Delete:
+  {
+    std::optional<QVector<int>> indices{readIndices(in)};
+    if (!indices.has_value())
+    {
+      return std::nullopt;
+    }
+    edit.indices = std::move(*indices);
+    break;
+  }
+  case SceneEdit::Kind::Insert:
+  {
+    std::optional<QVector<int>> indices{readIndices(in)};
+    quint32 count{0};
+    in >> count;
+    if (
+      !indices.has_value() ||
+      static_cast<qsizetype>(count) != indices->size())
+    {
+      return std::nullopt;
+    }
+    edit.indices = std::move(*indices);
+    edit.shapes.reserve(count);
+    for (quint32 n{0}; n < count && in.status() == QDataStream::Ok; ++n)
+    {
+      std::optional<Shape> shape{readShape(in)};
+      if (!shape.has_value())
+      {
+        return std::nullopt;
+      }
+      edit.shapes.push_back(*shape);
+    }
+    break;
+  }
+  case SceneEdit::Kind::Settings:
+  {
+    quint8 fill{0};
+    in >> fill;
+    const ShapeStyle style{readStyle(in)};
+    edit.settings.fill = fill != 0;
+    edit.settings.penColor = style.pen;
+    edit.settings.fillColor = style.fill;
+    edit.settings.penWidth = style.width;
+    break;
+  }
+  default:
+    return std::nullopt;
+  }
+
+  if (in.status() != QDataStream::Ok || !in.atEnd())
+  {
+    return std::nullopt;
+  }
+  return edit;
+}
+} // namespace
+
+QString EditJournal::journalPath(const QString& drawingPath)
+{
+  return drawingPath + QStringLiteral(".journal");
+}
+
+QVector<SceneEdit>
+EditJournal::open(const QString& drawingPath, const qsizetype baseCount)
+{
+  this->close();
+
+  const QString path{journalPath(drawingPath)};
+  const QFileInfo journalInfo{path};
+  const QFileInfo drawingInfo{drawingPath};
+  const bool current{
+    journalInfo.isFile() &&
+    (!drawingInfo.exists() ||
+     journalInfo.lastModified() >= drawingInfo.lastModified())};
+
+  QByteArray data{};
+  if (current)
+  {
+    QFile existing{path};
+    if (existing.open(QIODevice::ReadOnly))
+    {
+      data = existing.readAll();
+    }
+  }
+
+  const bool belongs{
+    data.startsWith(encodeHeader(baseCount)) ||
+    data.startsWith(encodeHeader(anyBase))};
+  if (!belongs)
+  {
+    this->start(drawingPath, baseCount);
+    return {};
+  }
+
+  qsizetype end{0};
+  const QVector<SceneEdit> edits{decode(data, headerSize(), end)};
+
+  // Continue behind the last good record, a torn one left by a crash is
+  // cut off
+  this->file.setFileName(path);
+  if (
+    !this->file.open(QIODevice::ReadWrite) || !this->file.resize(end) ||
+    !this->file.seek(end))
+  {
+    this->file.close();
+    return edits;
+  }
+  this->drawingPath = drawingPath;
+  this->records = static_cast<int>(edits.size());
+  ++this->session;
+  return edits;
+}
+
+bool EditJournal::start(const QString& drawingPath, const qsizetype baseCount)
+{
+  this->close();
+
+  this->file.setFileName(journalPath(drawingPath));
+  if (!this->file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+  {
+    return false;
+  }
+  this->drawingPath = drawingPath;
+  this->records = 0;
+  ++this->session;
+
+  const QByteArray header{encodeHeader(baseCount)};
+  return this->file.write(header) == header.size() && this->file.flush();
+}
+
+void EditJournal::close()
+{
+  if (!this->file.isOpen())
+  {
+    return;
+  }
+  this->file.close();
+  if (this->records == 0)
+  {
+    this->file.remove();
+  }
+}
+
+bool EditJournal::isOpen() const
+{
+  return this->file.isOpen();
+}
+
+bool EditJournal::append(const SceneEdit& edit)
+{
+  if (!this->file.isOpen())
+  {
+    return false;
+  }
+
+  // One write per record, so a crash tears at most the last one. Flushing
+  // hands it to the system; it survives the app dying, not the machine
+  const QByteArray record{encode(edit)};
+  if (this->file.write(record) != record.size() || !this->file.flush())
+  {
+    return false;
+  }
+  ++this->records;
+  return true;
+}
+
+EditJournal::Mark EditJournal::mark() const
+{
+  return Mark{this->file.isOpen() ? this->file.size() : -1, this->session};
+}
+
+qint64 EditJournal::size() const
+{
+  return this->file.isOpen() ? this->file.size() : 0;
+}
+
+int EditJournal::recordCount() const
+{
+  return this->records;
+}
+
+bool EditJournal::compact(
+  const Mark& mark, const qsizetype baseCount, const QString& drawingPath)
+{
+  if (
+    !this->file.isOpen() || mark.session != this->session ||
+    mark.offset < headerSize() || mark.offset > this->file.size())
+  {
+    return false;
+  }
+
+  // Only the records written since the mark are read, the rest is dropped
+  if (!this->file.seek(mark.offset))
+  {
+    return false;
+  }
+  const QByteArray tail{this->file.readAll()};
+  qsizetype end{0};
+  const int tailRecords{static_cast<int>(decode(tail, 0, end).size())};
+
+  const QString oldPath{this->file.fileName()};
+  const QString newPath{journalPath(drawingPath)};
+  this->file.close();
+
+  QSaveFile out{newPath};
+  const bool written{
+    out.open(QIODevice::WriteOnly) &&
+    out.write(encodeHeader(baseCount)) == headerSize() &&
+    out.write(tail.left(end)) == end && out.commit()};
+  if (written && oldPath != newPath)
+  {
+    QFile::remove(oldPath);
+  }
+
+  // Keep appending to whichever journal is now current
+  this->file.setFileName(written ? newPath : oldPath);
+  if (!this->file.open(QIODevice::ReadWrite | QIODevice::Append))
+  {
+    return false;
+  }
+  if (written)
+  {
+    this->drawingPath = drawingPath;
+    this->records = tailRecords;
+  }
+  return written;
+}
+
+QByteArray EditJournal::encodeHeader(const qsizetype baseCount)
+{
+  QByteArray header{};
+  QDataStream out{&header, QIODevice::WriteOnly};
+  prepare(out);
+  out.writeRawData(magic, sizeof(magic));
+  out << static_cast<quint32>(version) << static_cast<qint64>(baseCount);
+  return header;
+}
+
+QByteArray EditJournal::encode(const SceneEdit& edit)
+{
+  const QByteArray payload{encodePayload(edit)};
+
+  QByteArray record{};
+  record.reserve(recordHeaderSize + payload.size());
+  QDataStream out{&record, QIODevice::WriteOnly};
+  prepare(out);
+  out << static_cast<quint8>(edit.kind)
+      << static_cast<quint32>(payload.size()) << qChecksum(payload);
+  out.writeRawData(payload.constData(), static_cast<int>(payload.size()));
+  return record;
+}
+
+QVector<SceneEdit> EditJournal::decode(
+  const QByteArray& data, const qsizetype from, qsizetype& end)
+{
+  QVector<SceneEdit> edits{};
+  qsizetype pos{from};
+  while (data.size() - pos >= recordHeaderSize)
+  {
+    QDataStream in{data.mid(pos, recordHeaderSize)};
+    prepare(in);
+    quint8 kind{0};
+    quint32 length{0};
+    quint16 checksum{0};
+    in >> kind >> length >> checksum;
+    if (
+      length > maxPayload ||
+      length > static_cast<quint64>(data.size() - pos - recordHeaderSize))
+    {
+      break;
+    }
+
+    const QByteArray payload{data.mid(pos + recordHeaderSize, length)};
+    if (qChecksum(payload) != checksum)
+    {
+      break;
+    }
+    const std::optional<SceneEdit> edit{decodePayload(kind, payload)};
+    if (!edit.has_value())
+    {
+      break;
+    }
+    edits.push_back(*edit);
+    pos += recordHeaderSize + length;
+  }
+  end = pos;
+  return edits;
+}
+
+qsizetype EditJournal::headerSize()
+{
+  return sizeof(magic) + sizeof(quint32) + sizeof(qint64);
+}
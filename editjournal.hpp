@@ -0,0 +1,80 @@
+#pragma once
+
+#include "sceneedit.hpp"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Append-only log of the edits made since a drawing was last saved, kept in
+// a file next to it. Each record holds only what changed: a new shape, the
+// positions and transform of a move, the positions of a clone or delete,
+// the shapes an undone delete puts back, or the new settings. Appending
+// costs as much as the edit is big, so every edit is written as it happens
+// and a crash loses at most the one being written.
+//
+// The header holds the shape count of the drawing the journal continues.
+// Records are length prefixed and checksummed; reading stops at the first
+// damaged one. Once a save has written a snapshot, compact() drops the
+// records the snapshot already contains.
+class EditJournal
+{
+public:
+  static constexpr int version{1};
+  // The journal starts with a Clear record and fits any drawing
+  static constexpr qsizetype anyBase{-1};
+
+  // File name of the journal for a drawing
+  static QString journalPath(const QString& drawingPath);
+
+  // Opens the journal of the drawing at drawingPath, just loaded with
+  // baseCount shapes, for appending. Returns the edits of an earlier
+  // session that the drawing does not contain yet, for the caller to
+  // replay. A journal that is older than the drawing or was started from
+  // another scene is discarded and a fresh one started
+  QVector<SceneEdit>
+  open(const QString& drawingPath, const qsizetype baseCount);
+  // Starts a fresh journal, replacing an existing one
+  bool start(const QString& drawingPath, const qsizetype baseCount);
+  // Removes the file if it holds no records
+  void close();
+  bool isOpen() const;
+
+  bool append(const SceneEdit& edit);
+
+  // Position behind the last record of this journal
+  struct Mark
+  {
+    qint64 offset{-1};
+    int session{0};
+  };
+
+  // Take it together with the snapshot a save writes and hand both to
+  // compact() once the save has finished
+  Mark mark() const;
+  qint64 size() const;
+  int recordCount() const;
+  // Continues the journal for the snapshot saved at drawingPath, which
+  // holds every record before mark and baseCount shapes. Records after the
+  // mark are kept. The drawing may have been saved under a new name, the
+  // old journal is removed then. Fails if the journal was restarted since
+  // the mark was taken
+  bool compact(
+    const Mark& mark, const qsizetype baseCount, const QString& drawingPath);
+
+private:
+  QFile file{};
+  QString drawingPath{};
+  int records{0};
+  // Counts open() and start() so marks of an older journal are refused
+  int session{0};
+
+  static QByteArray encodeHeader(const qsizetype baseCount);
+  static QByteArray encode(const SceneEdit& edit);
+  // Reads the records starting at from, stopping at the first damaged one.
+  // end receives the position behind the last good record
+  static QVector<SceneEdit>
+  decode(const QByteArray& data, const qsizetype from, qsizetype& end);
+  static qsizetype headerSize();
+};
@@ -0,0 +1,154 @@
+#include "framestats.hpp"
+
+#include <QSaveFile>
+#include <QTextStream>
+
+// C++ standard
+#include <algorithm>
+#include <ranges>
+
+FrameStats::FrameStats()
+{
+  this->frames.reserve(capacity);
+  this->clock.start();
+}
+
+void FrameStats::addFrame(
+  const qint64 paintNs,
+  const qint64 allocations,
+  const int drawn,
+  const int culled,
+  const int selected)
+{
+  const Frame frame{
+    this->clock.nsecsElapsed(), paintNs, allocations, drawn, culled, selected};
+  if (this->frames.size() < capacity)
+  {
+    this->frames.push_back(frame);
+    return;
+  }
+  this->frames[this->next] = frame;
+  this->next = (this->next + 1) % capacity;
+}
+
+void FrameStats::clear()
+{
+  this->frames.clear();
+  this->next = 0;
+  this->clock.start();
+  this->lastHitTestNs = 0;
+  this->lastEditNs = 0;
+}
+
+qsizetype FrameStats::size() const
+{
+  return this->frames.size();
+}
+
+bool FrameStats::isEmpty() const
+{
+  return this->frames.isEmpty();
+}
+
+const FrameStats::Frame& FrameStats::frame(const qsizetype i) const
+{
+  return this->frames.at((this->next + i) % this->frames.size());
+}
+
+const FrameStats::Frame& FrameStats::last() const
+{
+  return this->frame(this->frames.size() - 1);
+}
+
+int FrameStats::fps() const
+{
+  if (this->frames.isEmpty())
+  {
+    return 0;
+  }
+
+  const qint64 since{this->last().timeNs - 1000000000};
+  return static_cast<int>(std::ranges::count_if(
+    this->frames,
+    [since](const Frame& frame)
+    {
+      return frame.timeNs > since;
+    }));
+}
+
+double FrameStats::averagePaintMs() const
+{
+  if (this->frames.isEmpty())
+  {
+    return 0.0;
+  }
+
+  qint64 total{0};
+  std::ranges::for_each(
+    this->frames,
+    [&total](const Frame& frame)
+    {
+      total += frame.paintNs;
+    });
+  return total / 1.0e6 / this->frames.size();
+}
+
+FrameStats::Histogram FrameStats::histogram() const
+{
+  Histogram buckets{};
+  std::ranges::for_each(
+    this->frames,
+    [&buckets](const Frame& frame)
+    {
+      const auto it{std::ranges::find_if(
+        bucketLimits,
+        [&frame](const int limit)
+        {
+          return frame.paintNs < limit * qint64{1000000};
+        })};
+      ++buckets[std::distance(bucketLimits.begin(), it)];
+    });
+  return buckets;
+}
+
+qint64 FrameStats::getLastHitTestNs() const
+{
+  return this->lastHitTestNs;
+}
+
+void FrameStats::setLastHitTestNs(const qint64 newLastHitTestNs)
+{
+  this->lastHitTestNs = newLastHitTestNs;
+}
+
+qint64 FrameStats::getLastEditNs() const
+{
+  return this->lastEditNs;
+}
+
+void FrameStats::setLastEditNs(const qint64 newLastEditNs)
+{
+  this->lastEditNs = newLastEditNs;
+}
+
+bool FrameStats::writeCsv(const QString& path) const
+{
+  QSaveFile file{path};
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+  {
+    return false;
+  }
+
+  QTextStream out{&file};
+  out << "time_ms,paint_ms,allocations,drawn,culled,selected\n";
+  for (qsizetype i{0}; i < this->frames.size(); ++i)
+  {
+    const Frame& frame{this->frame(i)};
+    out << QString::number(frame.timeNs / 1.0e6, 'f', 3) << ','
+        << QString::number(frame.paintNs / 1.0e6, 'f', 3) << ','
+        << frame.allocations << ',' << frame.drawn << ',' << frame.culled
+        << ',' << frame.selected << '\n';
+  }
+  out.flush();
+  return out.status() == QTextStream::Ok && file.commit();
+}
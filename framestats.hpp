@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+// C++ standard
+#include <array>
+
+// Rolling record of the latest frames a canvas painted, with the cost of
+// its last hit test and last edit, for the stats overlay and the CSV
+// export. Keeps a fixed number of frames, the oldest are overwritten.
+class FrameStats
+{
+public:
+  struct Frame
+  {
+    // Since the stats were started or cleared
+    qint64 timeNs{0};
+    qint64 paintNs{0};
+    // Zero unless AllocationCounter is built in
+    qint64 allocations{0};
+    int drawn{0};
+    int culled{0};
+    int selected{0};
+  };
+
+  static constexpr qsizetype capacity{600};
+  // Upper bounds of the paint time buckets in milliseconds, a last bucket
+  // takes everything slower
+  static constexpr std::array<int, 6> bucketLimits{1, 2, 4, 8, 16, 33};
+  using Histogram = std::array<int, bucketLimits.size() + 1>;
+
+  FrameStats();
+
+  void addFrame(
+    const qint64 paintNs,
+    const qint64 allocations,
+    const int drawn,
+    const int culled,
+    const int selected);
+  void clear();
+
+  qsizetype size() const;
+  bool isEmpty() const;
+  // Oldest first
+  const Frame& frame(const qsizetype i) const;
+  const Frame& last() const;
+
+  // Frames painted during the second before the newest one
+  int fps() const;
+  double averagePaintMs() const;
+  Histogram histogram() const;
+
+  qint64 getLastHitTestNs() const;
+  void setLastHitTestNs(const qint64 newLastHitTestNs);
+  qint64 getLastEditNs() const;
+  void setLastEditNs(const qint64 newLastEditNs);
+
+  bool writeCsv(const QString& path) const;
+
+private:
+  QVector<Frame> frames{};
+  // Slot the next frame goes to once the ring is full
+  qsizetype next{0};
+  QElapsedTimer clock{};
+  qint64 lastHitTestNs{0};
+  qint64 lastEditNs{0};
+};
@@ -0,0 +1,378 @@
+#include "geometrykernels.hpp"
+
+// C++ standard
+#include <atomic>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||           \
+  defined(_M_IX86)
+#define GEOMETRY_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC emits any intrinsic without per-function target flags
+#define KERNEL_SSE2
+#define KERNEL_AVX2
+#else
+#define KERNEL_SSE2 __attribute__((target("sse2")))
+#define KERNEL_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+using GeometryKernels::Isa;
+
+// Scalar bodies. The SIMD versions evaluate exactly the same expressions in
+// the same order, which keeps all paths bit-identical without FMA
+
+void translateScalar(
+  qreal* const xy, const qsizetype count, const qreal dx, const qreal dy)
+{
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    xy[2 * i] += dx;
+    xy[2 * i + 1] += dy;
+  }
+}
+
+void rotateScalar(
+  qreal* const xy,
+  const qsizetype count,
+  const qreal px,
+  const qreal py,
+  const qreal c,
+  const qreal s)
+{
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    const qreal dx{xy[2 * i] - px};
+    const qreal dy{xy[2 * i + 1] - py};
+    xy[2 * i] = px + (dx * c + dy * -s);
+    xy[2 * i + 1] = py + (dy * c + dx * s);
+  }
+}
+
+void boundsScalar(
+  const GeometryKernels::Boxes& b,
+  const qsizetype from,
+  const qsizetype to,
+  const GeometryKernels::Bounds& out)
+{
+  for (qsizetype i{from}; i < to; ++i)
+  {
+    const qreal xc{b.hx[i] * b.cosA[i]};
+    const qreal ys{b.hy[i] * b.sinA[i]};
+    const qreal xs{b.hx[i] * b.sinA[i]};
+    const qreal yc{b.hy[i] * b.cosA[i]};
+    const bool round{b.round[i] != 0.0};
+    const qreal ex{
+      round ? std::sqrt(xc * xc + ys * ys) : std::abs(xc) + std::abs(ys)};
+    const qreal ey{
+      round ? std::sqrt(xs * xs + yc * yc) : std::abs(xs) + std::abs(yc)};
+    out.left[i] = b.cx[i] - ex;
+    out.right[i] = b.cx[i] + ex;
+    out.top[i] = b.cy[i] - ey;
+    out.bottom[i] = b.cy[i] + ey;
+  }
+}
+
+#ifdef GEOMETRY_KERNELS_X86
+static_assert(
+  std::is_same_v<qreal, double>,
+  "The SIMD kernels assume double precision coordinates");
+
+KERNEL_SSE2 void translateSse2(
+  qreal* const xy, const qsizetype count, const qreal dx, const qreal dy)
+{
+  const __m128d d{_mm_set_pd(dy, dx)};
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    _mm_storeu_pd(xy + 2 * i, _mm_add_pd(_mm_loadu_pd(xy + 2 * i), d));
+  }
+}
+
+KERNEL_AVX2 void translateAvx2(
+  qreal* const xy, const qsizetype count, const qreal dx, const qreal dy)
+{
+  const __m256d d{_mm256_set_pd(dy, dx, dy, dx)};
+  qsizetype i{0};
+  for (; i + 2 <= count; i += 2)
+  {
+    _mm256_storeu_pd(
+      xy + 2 * i, _mm256_add_pd(_mm256_loadu_pd(xy + 2 * i), d));
+  }
+  translateScalar(xy + 2 * i, count - i, dx, dy);
+}
+
+KERNEL_SSE2 void rotateSse2(
+  qreal* const xy,
+  const qsizetype count,
+  const qreal px,
+  const qreal py,
+  const qreal c,
+  const qreal s)
+{
+  const __m128d pivot{_mm_set_pd(py, px)};
+  const __m128d cc{_mm_set1_pd(c)};
+  const __m128d ss{_mm_set_pd(s, -s)};
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    // [dx, dy] * [c, c] + [dy, dx] * [-s, s]
+    const __m128d d{_mm_sub_pd(_mm_loadu_pd(xy + 2 * i), pivot)};
+    const __m128d swapped{_mm_shuffle_pd(d, d, 1)};
+    const __m128d turned{
+      _mm_add_pd(_mm_mul_pd(d, cc), _mm_mul_pd(swapped, ss))};
+    _mm_storeu_pd(xy + 2 * i, _mm_add_pd(pivot, turned));
+  }
+}
+
+KERNEL_AVX2 void rotateAvx2(
+  qreal* const xy,
+  const qsizetype count,
+  const qreal px,
+  const qreal py,
+  const qreal c,
+  const qreal s)
+{
+  const __m256d pivot{_mm256_set_pd(py, px, py, px)};
+  const __m256d cc{_mm256_set1_pd(c)};
+  const __m256d ss{_mm256_set_pd(s, -s, s, -s)};
+  qsizetype i{0};
+  for (; i + 2 <= count; i += 2)
+  {
+    const __m256d d{_mm256_sub_pd(_mm256_loadu_pd(xy + 2 * i), pivot)};
+    const __m256d swapped{_mm256_permute_pd(d, 0b0101)};
+    const __m256d turned{
+      _mm256_add_pd(_mm256_mul_pd(d, cc), _mm256_mul_pd(swapped, ss))};
+    _mm256_storeu_pd(xy + 2 * i, _mm256_add_pd(pivot, turned));
+  }
+  rotateScalar(xy + 2 * i, count - i, px, py, c, s);
+}
+
+KERNEL_SSE2 void boundsSse2(
+  const GeometryKernels::Boxes& b,
+  const qsizetype count,
+  const GeometryKernels::Bounds& out)
+{
+  const __m128d signMask{_mm_set1_pd(-0.0)};
+  const __m128d zero{_mm_setzero_pd()};
+
+  qsizetype i{0};
+  for (; i + 2 <= count; i += 2)
+  {
+    const __m128d hx{_mm_loadu_pd(b.hx + i)};
+    const __m128d hy{_mm_loadu_pd(b.hy + i)};
+    const __m128d c{_mm_loadu_pd(b.cosA + i)};
+    const __m128d s{_mm_loadu_pd(b.sinA + i)};
+    const __m128d round{_mm_cmpneq_pd(_mm_loadu_pd(b.round + i), zero)};
+    const __m128d xc{_mm_mul_pd(hx, c)};
+    const __m128d ys{_mm_mul_pd(hy, s)};
+    const __m128d xs{_mm_mul_pd(hx, s)};
+    const __m128d yc{_mm_mul_pd(hy, c)};
+    // SSE2 has no blend, select through the comparison mask
+    const __m128d ex{_mm_or_pd(
+      _mm_and_pd(
+        round,
+        _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xc, xc), _mm_mul_pd(ys, ys)))),
+      _mm_andnot_pd(
+        round,
+        _mm_add_pd(
+          _mm_andnot_pd(signMask, xc), _mm_andnot_pd(signMask, ys))))};
+    const __m128d ey{_mm_or_pd(
+      _mm_and_pd(
+        round,
+        _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xs, xs), _mm_mul_pd(yc, yc)))),
+      _mm_andnot_pd(
+        round,
+        _mm_add_pd(
+          _mm_andnot_pd(signMask, xs), _mm_andnot_pd(signMask, yc))))};
+    const __m128d cx{_mm_loadu_pd(b.cx + i)};
+    const __m128d cy{_mm_loadu_pd(b.cy + i)};
+    _mm_storeu_pd(out.left + i, _mm_sub_pd(cx, ex));
+    _mm_storeu_pd(out.right + i, _mm_add_pd(cx, ex));
+    _mm_storeu_pd(out.top + i, _mm_sub_pd(cy, ey));
+    _mm_storeu_pd(out.bottom + i, _mm_add_pd(cy, ey));
+  }
+  boundsScalar(b, i, count, out);
+}
+
+KERNEL_AVX2 void boundsAvx2(
+  const GeometryKernels::Boxes& b,
+  const qsizetype count,
+  const GeometryKernels::Bounds& out)
+{
+  const __m256d signMask{_mm256_set1_pd(-0.0)};
+  const __m256d zero{_mm256_setzero_pd()};
+
+  qsizetype i{0};
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m256d hx{_mm256_loadu_pd(b.hx + i)};
+    const __m256d hy{_mm256_loadu_pd(b.hy + i)};
+    const __m256d c{_mm256_loadu_pd(b.cosA + i)};
+    const __m256d s{_mm256_loadu_pd(b.sinA + i)};
+    const __m256d round{
+      _mm256_cmp_pd(_mm256_loadu_pd(b.round + i), zero, _CMP_NEQ_UQ)};
+    const __m256d xc{_mm256_mul_pd(hx, c)};
+    const __m256d ys{_mm256_mul_pd(hy, s)};
+    const __m256d xs{_mm256_mul_pd(hx, s)};
+    const __m256d yc{_mm256_mul_pd(hy, c)};
+    const __m256d ex{_mm256_blendv_pd(
+      _mm256_add_pd(
+        _mm256_andnot_pd(signMask, xc), _mm256_andnot_pd(signMask, ys)),
+      _mm256_sqrt_pd(
+        _mm256_add_pd(_mm256_mul_pd(xc, xc), _mm256_mul_pd(ys, ys))),
+      round)};
+    const __m256d ey{_mm256_blendv_pd(
+      _mm256_add_pd(
+        _mm256_andnot_pd(signMask, xs), _mm256_andnot_pd(signMask, yc)),
+      _mm256_sqrt_pd(
+        _mm256_add_pd(_mm256_mul_pd(xs, xs), _mm256_mul_pd(yc, yc))),
+      round)};
+    const __m256d cx{_mm256_loadu_pd(b.cx + i)};
+    const __m256d cy{_mm256_loadu_pd(b.cy + i)};
+    _mm256_storeu_pd(out.left + i, _mm256_sub_pd(cx, ex));
+    _mm256_storeu_pd(out.right + i, _mm256_add_pd(cx, ex));
+    _mm256_storeu_pd(out.top + i, _mm256_sub_pd(cy, ey));
+    _mm256_storeu_pd(out.bottom + i, _mm256_add_pd(cy, ey));
+  }
+  boundsScalar(b, i, count, out);
+}
+
+Isa detectIsa()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4]{};
+  __cpuid(info, 0);
+  const int maxLeaf{info[0]};
+  __cpuid(info, 1);
+  const bool sse2{(info[3] & (1 << 26)) != 0};
+  const bool osxsave{(info[2] & (1 << 27)) != 0};
+  const bool avx{(info[2] & (1 << 28)) != 0};
+  bool avx2{false};
+  if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+#else
+  __builtin_cpu_init();
+  const bool sse2{__builtin_cpu_supports("sse2") != 0};
+  const bool avx2{__builtin_cpu_supports("avx2") != 0};
+#endif
+  if (avx2)
+  {
+    return Isa::Avx2;
+  }
+  return sse2 ? Isa::Sse2 : Isa::Scalar;
+}
+#else
+Isa detectIsa()
+{
+  return Isa::Scalar;
+}
+#endif
+
+std::atomic<Isa>& currentIsa()
+{
+  static std::atomic<Isa> isa{GeometryKernels::bestIsa()};
+  return isa;
+}
+} // namespace
+
+namespace GeometryKernels
+{
+Isa bestIsa()
+{
+  static const Isa best{detectIsa()};
+  return best;
+}
+
+Isa activeIsa()
+{
+  return currentIsa().load(std::memory_order_relaxed);
+}
+
+void setActiveIsa(const Isa isa)
+{
+  const Isa clamped{
+    static_cast<int>(isa) > static_cast<int>(bestIsa()) ? bestIsa() : isa};
+  currentIsa().store(clamped, std::memory_order_relaxed);
+}
+
+const char* isaName(const Isa isa)
+{
+  switch (isa)
+  {
+    case Isa::Avx2:
+      return "AVX2";
+    case Isa::Sse2:
+      return "SSE2";
+    case Isa::Scalar:
+      break;
+  }
+  return "scalar";
+}
+
+void translate(qreal* const xy, const qsizetype count, const QPointF& delta)
+{
+#ifdef GEOMETRY_KERNELS_X86
+  switch (activeIsa())
+  {
+    case Isa::Avx2:
+      translateAvx2(xy, count, delta.x(), delta.y());
+      return;
+    case Isa::Sse2:
+      translateSse2(xy, count, delta.x(), delta.y());
+      return;
+    case Isa::Scalar:
+      break;
+  }
+#endif
+  translateScalar(xy, count, delta.x(), delta.y());
+}
+
+void rotate(
+  qreal* const xy,
+  const qsizetype count,
+  const QPointF& pivot,
+  const qreal angle)
+{
+  const qreal c{std::cos(angle)};
+  const qreal s{std::sin(angle)};
+#ifdef GEOMETRY_KERNELS_X86
+  switch (activeIsa())
+  {
+    case Isa::Avx2:
+      rotateAvx2(xy, count, pivot.x(), pivot.y(), c, s);
+      return;
+    case Isa::Sse2:
+      rotateSse2(xy, count, pivot.x(), pivot.y(), c, s);
+      return;
+    case Isa::Scalar:
+      break;
+  }
+#endif
+  rotateScalar(xy, count, pivot.x(), pivot.y(), c, s);
+}
+
+void rotatedBounds(const Boxes& boxes, const qsizetype count, Bounds out)
+{
+#ifdef GEOMETRY_KERNELS_X86
+  switch (activeIsa())
+  {
+    case Isa::Avx2:
+      boundsAvx2(boxes, count, out);
+      return;
+    case Isa::Sse2:
+      boundsSse2(boxes, count, out);
+      return;
+    case Isa::Scalar:
+      break;
+  }
+#endif
+  boundsScalar(boxes, 0, count, out);
+}
+} // namespace GeometryKernels
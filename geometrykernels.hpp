@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QPointF>
+#include <QtGlobal>
+
+// Batch arithmetic over contiguous coordinate arrays. Each kernel has a
+// scalar, an SSE2 and an AVX2 body that produce bit-identical results; the
+// widest one the CPU supports is chosen on first use.
+namespace GeometryKernels
+{
+enum class Isa
+{
+  Scalar,
+  Sse2,
+  Avx2,
+};
+
+Isa bestIsa();
+Isa activeIsa();
+// Requests above bestIsa() are lowered to it, meant for measurements
+void setActiveIsa(const Isa isa);
+const char* isaName(const Isa isa);
+
+// Adds delta to count points stored as x0, y0, x1, y1, ...
+void translate(qreal* const xy, const qsizetype count, const QPointF& delta);
+// Turns count interleaved points around pivot, same direction as
+// QTransform::rotateRadians
+void rotate(
+  qreal* const xy,
+  const qsizetype count,
+  const QPointF& pivot,
+  const qreal angle);
+
+// Rectangles or ellipses given by center and half extents, turned around
+// their center. round is 0.0 for a rectangle and 1.0 for an ellipse
+struct Boxes
+{
+  const qreal* cx{nullptr};
+  const qreal* cy{nullptr};
+  const qreal* hx{nullptr};
+  const qreal* hy{nullptr};
+  const qreal* cosA{nullptr};
+  const qreal* sinA{nullptr};
+  const qreal* round{nullptr};
+};
+
+struct Bounds
+{
+  qreal* left{nullptr};
+  qreal* top{nullptr};
+  qreal* right{nullptr};
+  qreal* bottom{nullptr};
+};
+
+// Exact axis aligned bounds of count turned boxes
+void rotatedBounds(const Boxes& boxes, const qsizetype count, Bounds out);
+} // namespace GeometryKernels
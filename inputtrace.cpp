@@ -0,0 +1,226 @@
+#include "inputtrace.hpp"
+
+#include <QFile>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QSaveFile>
+#include <QTextStream>
+
+// C++ standard
+#include <algorithm>
+#include <cstring>
+#include <ranges>
+
+namespace
+{
+constexpr const char* magic{"qshapes-trace"};
+} // namespace
+
+InputTrace::InputTrace(QObject* const parent) : QObject{parent}
+{
+}
+
+QString InputTrace::recordPath(const int argc, char* argv[])
+{
+  for (int i{1}; i + 1 < argc; ++i)
+  {
+    if (std::strcmp(argv[i], switchName) == 0)
+    {
+      return QString::fromLocal8Bit(argv[i + 1]);
+    }
+  }
+  return QString{};
+}
+
+bool InputTrace::isRecording() const
+{
+  return this->recording;
+}
+
+void InputTrace::setRecording(const bool isRecording)
+{
+  this->recording = isRecording;
+}
+
+const QVector<InputTrace::Event>& InputTrace::events() const
+{
+  return this->recorded;
+}
+
+QSize InputTrace::getCanvasSize() const
+{
+  return this->canvasSize;
+}
+
+bool InputTrace::eventFilter(QObject* watched, QEvent* event)
+{
+  const QEvent::Type type{event->type()};
+  if (
+    !this->recording ||
+    (type != QEvent::MouseButtonPress && type != QEvent::MouseMove &&
+     type != QEvent::MouseButtonRelease && type != QEvent::KeyPress))
+  {
+    return QObject::eventFilter(watched, event);
+  }
+
+  const PaintCanvas* const canvas{qobject_cast<PaintCanvas*>(watched)};
+  if (canvas == nullptr)
+  {
+    return QObject::eventFilter(watched, event);
+  }
+
+  if (this->recorded.isEmpty())
+  {
+    this->clock.start();
+    this->canvasSize = canvas->size();
+  }
+
+  Event recordedEvent{};
+  recordedEvent.timeNs = this->clock.nsecsElapsed();
+  recordedEvent.tool = canvas->getTool();
+  recordedEvent.modifiers = static_cast<QInputEvent*>(event)->modifiers();
+  if (type == QEvent::KeyPress)
+  {
+    recordedEvent.type = Event::Type::Key;
+    recordedEvent.key = static_cast<QKeyEvent*>(event)->key();
+  }
+  else
+  {
+    const QMouseEvent* const mouse{static_cast<QMouseEvent*>(event)};
+    recordedEvent.type =
+      type == QEvent::MouseButtonPress ? Event::Type::Press
+      : type == QEvent::MouseMove      ? Event::Type::Move
+                                       : Event::Type::Release;
+    recordedEvent.pos = mouse->position();
+    recordedEvent.button = mouse->button();
+    recordedEvent.buttons = mouse->buttons();
+  }
+  this->recorded.push_back(recordedEvent);
+
+  // Only watching, the canvas still gets the event
+  return QObject::eventFilter(watched, event);
+}
+
+bool InputTrace::save(const QString& path) const
+{
+  QSaveFile file{path};
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+  {
+    return false;
+  }
+
+  QTextStream out{&file};
+  out.setRealNumberPrecision(12);
+  out << magic << ' ' << version << ' ' << this->canvasSize.width() << ' '
+      << this->canvasSize.height() << '\n';
+  std::ranges::for_each(
+    this->recorded,
+    [&out](const Event& event)
+    {
+      out << static_cast<int>(event.type) << ' ' << event.timeNs << ' '
+          << event.pos.x() << ' ' << event.pos.y() << ' '
+          << static_cast<int>(event.button) << ' ' << event.buttons.toInt()
+          << ' ' << event.modifiers.toInt() << ' ' << event.key << ' '
+          << static_cast<int>(event.tool) << '\n';
+    });
+  out.flush();
+  return out.status() == QTextStream::Ok && file.commit();
+}
+
+bool InputTrace::load(const QString& path)
+{
+  QFile file{path};
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+  {
+    return false;
+  }
+
+  QTextStream in{&file};
+  QString header{};
+  int fileVersion{0};
+  int width{0};
+  int height{0};
+  in >> header >> fileVersion >> width >> height;
+  if (header != magic || fileVersion != version)
+  {
+    return false;
+  }
+
+  QVector<Event> events{};
+  while (true)
+  {
+    int type{0};
+    qint64 timeNs{0};
+    qreal x{0.0};
+    qreal y{0.0};
+    int button{0};
+    int buttons{0};
+    int modifiers{0};
+    int key{0};
+    int tool{0};
+    in >> type >> timeNs >> x >> y >> button >> buttons >> modifiers >> key >>
+      tool;
+    if (in.status() != QTextStream::Ok)
+    {
+      break;
+    }
+    if (
+      type < static_cast<int>(Event::Type::Press) ||
+      type > static_cast<int>(Event::Type::Key) ||
+      tool < static_cast<int>(PaintCanvas::ToolType::Modify) ||
+      tool > static_cast<int>(PaintCanvas::ToolType::Ellipse))
+    {
+      return false;
+    }
+
+    Event event{};
+    event.type = static_cast<Event::Type>(type);
+    event.timeNs = timeNs;
+    event.pos = QPointF{x, y};
+    event.button = static_cast<Qt::MouseButton>(button);
+    event.buttons = Qt::MouseButtons::fromInt(buttons);
+    event.modifiers = Qt::KeyboardModifiers::fromInt(modifiers);
+    event.key = key;
+    event.tool = static_cast<PaintCanvas::ToolType>(tool);
+    events.push_back(event);
+  }
+
+  this->recorded = std::move(events);
+  this->canvasSize = QSize{width, height};
+  return true;
+}
+
+std::unique_ptr<QInputEvent> InputTrace::toInputEvent(const Event& event)
+{
+  switch (event.type)
+  {
+  case Event::Type::Press:
+    return std::make_unique<QMouseEvent>(
+      QEvent::MouseButtonPress,
+      event.pos,
+      event.pos,
+      event.button,
+      event.buttons,
+      event.modifiers);
+  case Event::Type::Move:
+    return std::make_unique<QMouseEvent>(
+      QEvent::MouseMove,
+      event.pos,
+      event.pos,
+      event.button,
+      event.buttons,
+      event.modifiers);
+  case Event::Type::Release:
+    return std::make_unique<QMouseEvent>(
+      QEvent::MouseButtonRelease,
+      event.pos,
+      event.pos,
+      event.button,
+      event.buttons,
+      event.modifiers);
+  case Event::Type::Key:
+    return std::make_unique<QKeyEvent>(
+      QEvent::KeyPress, event.key, event.modifiers);
+  }
+  return nullptr;
+}
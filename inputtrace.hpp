@@ -0,0 +1,78 @@
+#pragma once
+
+#include "paintcanvas.hpp"
+
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QInputEvent>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+// C++ standard
+#include <memory>
+
+// The mouse and key events a PaintCanvas received and when they arrived,
+// for replaying real gestures against a scene. Installed as an event filter
+// on the application it records the presses, moves, releases and key
+// presses of every canvas, together with the tool that was active.
+//
+// Traces are text, one event per line after a header line:
+//   type time_ns x y button buttons modifiers key tool
+class InputTrace : public QObject
+{
+  Q_OBJECT
+public:
+  static constexpr int version{1};
+  // Command line switch of the app, followed by the file to write on exit
+  static constexpr const char* switchName{"--record-trace"};
+
+  struct Event
+  {
+    // Numbering is what the files store
+    enum class Type : quint8
+    {
+      Press = 1,
+      Move = 2,
+      Release = 3,
+      Key = 4,
+    };
+
+    Type type{Type::Move};
+    // Since the first recorded event
+    qint64 timeNs{0};
+    QPointF pos{};
+    Qt::MouseButton button{Qt::NoButton};
+    Qt::MouseButtons buttons{Qt::NoButton};
+    Qt::KeyboardModifiers modifiers{Qt::NoModifier};
+    int key{0};
+    PaintCanvas::ToolType tool{PaintCanvas::ToolType::Modify};
+  };
+
+  explicit InputTrace(QObject* const parent = nullptr);
+
+  // File named after switchName on the command line, empty without it
+  static QString recordPath(const int argc, char* argv[]);
+
+  bool isRecording() const;
+  void setRecording(const bool isRecording);
+  const QVector<Event>& events() const;
+  // Size of the canvas when the first event was recorded
+  QSize getCanvasSize() const;
+
+  bool save(const QString& path) const;
+  bool load(const QString& path);
+
+  // The Qt event the canvas received
+  static std::unique_ptr<QInputEvent> toInputEvent(const Event& event);
+
+protected:
+  bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+  QVector<Event> recorded{};
+  QElapsedTimer clock{};
+  QSize canvasSize{};
+  bool recording{false};
+};
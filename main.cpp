@@ -1,9 +1,37 @@
+#include "batchrenderer.hpp"
+#include "inputtrace.hpp"
 #include "mainwindow.hpp"
+#include "traceevents.hpp"
 
 int main(int argc, char* argv[])
 {
+  TraceEvents::startFromCommandLine(argc, argv);
+  if (BatchRenderer::isRequested(argc, argv))
+  {
+    const int code{BatchRenderer::run(argc, argv)};
+    TraceEvents::stop();
+    return code;
+  }
+
+  const QString tracePath{InputTrace::recordPath(argc, argv)};
   QApplication a{argc, argv};
+
+  // Records what the canvas receives until the app exits
+  InputTrace trace{};
+  if (!tracePath.isEmpty())
+  {
+    trace.setRecording(true);
+    a.installEventFilter(&trace);
+  }
+
   MainWindow w{nullptr};
   w.show();
-  return a.exec();
+  const int code{a.exec()};
+
+  if (!tracePath.isEmpty())
+  {
+    trace.save(tracePath);
+  }
+  TraceEvents::stop();
+  return code;
 }
@@ -1,4 +1,15 @@
 #include "mainwindow.hpp"
+#include "scenefile.hpp"
+#include "traceevents.hpp"
+
+namespace
+{
+QImage readImage(const QString& path)
+{
+  const TraceSpan span{"decode PNG", "io"};
+  return QImage{path};
+}
+} // namespace
 
 MainWindow::MainWindow(QWidget* const parent)
   : QMainWindow{parent}, ui{new Ui::MainWindow{}}
@@ -8,9 +19,24 @@ MainWindow::MainWindow(QWidget* const parent)
   this->canvas = new PaintCanvas{this};
   this->setCentralWidget(this->canvas);
 
-  const QFileInfo exeInfo{QCoreApplication::applicationFilePath()};
-  this->currentFilePath = exeInfo.dir().filePath(
-    QStringLiteral("%1.png").arg(exeInfo.completeBaseName()));
+  this->saver = new SceneSaver{this};
+  this->connect(
+    this->saver,
+    &SceneSaver::progressChanged,
+    this,
+    &MainWindow::saveProgress);
+  this->connect(
+    this->saver,
+    &SceneSaver::finished,
+    this,
+    &MainWindow::saveFinished);
+  this->connect(
+    this->canvas,
+    &PaintCanvas::edited,
+    this,
+    &MainWindow::recordEdit);
+
+  this->currentFilePath = this->defaultFilePath();
 
   // set action icons
   this->ui->actionNew->setIcon(QIcon{":/images/new.png"});
@@ -45,6 +71,45 @@ MainWindow::MainWindow(QWidget* const parent)
     &QAction::triggered,
     this,
     &MainWindow::exitApp);
+  this->ui->actionUndo->setShortcut(QKeySequence::Undo);
+  this->ui->actionRedo->setShortcut(QKeySequence::Redo);
+  this->connect(
+    this->ui->actionUndo,
+    &QAction::triggered,
+    this,
+    &MainWindow::undo);
+  this->connect(
+    this->ui->actionRedo,
+    &QAction::triggered,
+    this,
+    &MainWindow::redo);
+  this->ui->actionZoomIn->setShortcut(QKeySequence::ZoomIn);
+  this->ui->actionZoomOut->setShortcut(QKeySequence::ZoomOut);
+  this->connect(
+    this->ui->actionZoomIn,
+    &QAction::triggered,
+    this->canvas,
+    &PaintCanvas::zoomIn);
+  this->connect(
+    this->ui->actionZoomOut,
+    &QAction::triggered,
+    this->canvas,
+    &PaintCanvas::zoomOut);
+  this->connect(
+    this->ui->actionResetView,
+    &QAction::triggered,
+    this->canvas,
+    &PaintCanvas::resetView);
+  this->connect(
+    this->ui->actionShowStats,
+    &QAction::toggled,
+    this,
+    &MainWindow::showStats);
+  this->connect(
+    this->ui->actionExportStats,
+    &QAction::triggered,
+    this,
+    &MainWindow::exportStats);
 
   QLabel* const penWidthLabel{new QLabel{"Pen Width", this}};
   this->penWidthSpinBox = new QSpinBox{this};
@@ -160,32 +225,20 @@ MainWindow::MainWindow(QWidget* const parent)
   this->ui->mainToolBar->addWidget(triangleButton);
   this->ui->mainToolBar->addWidget(circleButton);
 
-  const auto applyUiColors = [this]()
-  {
-    QString css{
-      QString{"background-color: %1"}.arg(this->canvas->getPenColor().name())};
-    this->penColorButton->setStyleSheet(css);
-
-    css =
-      QString{"background-color: %1"}.arg(this->canvas->getFillColor().name());
-    this->fillColorButton->setStyleSheet(css);
-    this->fillCheckBox->setChecked(this->canvas->getFill());
-    this->penWidthSpinBox->setValue(this->canvas->getPenWidth());
-  };
-
-  applyUiColors();
+  this->syncSettingsUi();
 
   const QFileInfo defaultFile{this->currentFilePath};
   if (defaultFile.isFile())
   {
-    const QImage img{defaultFile.absoluteFilePath()};
+    const QImage img{readImage(defaultFile.absoluteFilePath())};
     if (!img.isNull())
     {
-      const QString meta{img.text("shapes")};
-      this->canvas->loadFromSerialized(meta);
-      applyUiColors();
+      this->canvas->loadFromImage(img);
+      this->syncSettingsUi();
     }
   }
+  this->openJournal();
+  this->syncUndoUi();
 
   this->update();
 }
@@ -196,8 +249,11 @@ MainWindow::~MainWindow()
 
 void MainWindow::newFile()
 {
-  this->canvas->clearAll();
+  // The drawing will be saved to the default file, which may hold an older
+  // one. The journal starts with the clear, so it replays onto any of them
   this->currentFilePath.clear();
+  this->journal.start(this->journalTarget(), EditJournal::anyBase);
+  this->canvas->clearAll();
 
   this->statusBar()->showMessage(
     "New operation has been completed successfully");
@@ -211,36 +267,41 @@ void MainWindow::loadFile()
     this,
     this->tr("Load drawing"),
     QString{},
-    this->tr("PNG Images (*.png)"))};
+    this->tr("Drawings (*.png *.qshapes);;PNG Images (*.png);;"
+             "Scene files (*.qshapes)"))};
 
   if (path.isEmpty())
   {
     return;
   }
 
-  QImage img{path};
-  if (img.isNull())
+  if (SceneFile::isSceneFile(path))
   {
-    QMessageBox::warning(this, tr("Load failed"), tr("Cannot load image."));
-    return;
+    if (!this->canvas->openSceneFile(path))
+    {
+      QMessageBox::warning(
+        this, tr("Load failed"), tr("Cannot open scene file."));
+      return;
+    }
+  }
+  else
+  {
+    const QImage img{readImage(path)};
+    if (img.isNull())
+    {
+      QMessageBox::warning(this, tr("Load failed"), tr("Cannot load image."));
+      return;
+    }
+    this->canvas->loadFromImage(img);
   }
-
-  const QString meta{img.text("shapes")};
-  this->canvas->loadFromSerialized(meta);
   this->currentFilePath = path;
-
-  // sync UI with loaded settings
-  this->penWidthSpinBox->setValue(this->canvas->getPenWidth());
-  QString css{
-    QString{"background-color: %1"}.arg(this->canvas->getPenColor().name())};
-  this->penColorButton->setStyleSheet(css);
-  css =
-    QString{"background-color: %1"}.arg(this->canvas->getFillColor().name());
-  this->fillColorButton->setStyleSheet(css);
-  this->fillCheckBox->setChecked(this->canvas->getFill());
+  this->saveWithJson = false;
+  this->syncSettingsUi();
 
   this->statusBar()->showMessage(
     "Load operation has been completed successfully");
+  this->openJournal();
+  this->syncUndoUi();
 
   this->update();
 }
@@ -249,50 +310,88 @@ void MainWindow::saveFile()
 {
   if (this->currentFilePath.isEmpty())
   {
-    const QFileInfo exeInfo{QCoreApplication::applicationFilePath()};
-    this->currentFilePath = exeInfo.dir().filePath(
-      QStringLiteral("%1.png").arg(exeInfo.completeBaseName()));
-  }
-
-  QImage img{this->canvas->toImage()};
-  img.setText("shapes", this->canvas->toSerialized());
-
-  if (!img.save(this->currentFilePath, "PNG"))
-  {
-    QMessageBox::warning(this, tr("Save failed"), tr("Cannot save image."));
-    return;
+    this->currentFilePath = this->defaultFilePath();
   }
 
-  this->statusBar()->showMessage(
-    "Save operation has been completed successfully");
+  this->startSave(this->currentFilePath);
 }
 
 void MainWindow::saveFileAs()
 {
+  const QString compatibleFilter{
+    tr("PNG Images readable by older versions (*.png)")};
+  QString filter{};
   const QString path{QFileDialog::getSaveFileName(
     this,
     tr("Save drawing as"),
     this->currentFilePath,
-    tr("PNG Images (*.png)"))};
+    tr("PNG Images (*.png);;%1;;Scene files (*.qshapes)")
+      .arg(compatibleFilter),
+    &filter)};
 
   if (path.isEmpty())
   {
     return;
   }
 
-  QImage img{this->canvas->toImage()};
-  img.setText("shapes", this->canvas->toSerialized());
+  const bool previousWithJson{this->saveWithJson};
+  this->saveWithJson = filter == compatibleFilter;
+  if (this->startSave(path))
+  {
+    this->currentFilePath = path;
+  }
+  else
+  {
+    this->saveWithJson = previousWithJson;
+  }
+}
 
-  if (!img.save(path, "PNG"))
+bool MainWindow::startSave(const QString& path)
+{
+  if (this->saver->isBusy())
   {
-    QMessageBox::warning(this, tr("Save failed"), tr("Cannot save image."));
-    return;
+    this->statusBar()->showMessage(
+      tr("Still saving %1, try again when it is done")
+        .arg(QFileInfo{this->saver->getPath()}.fileName()));
+    return false;
   }
 
-  this->currentFilePath = path;
+  // Edits made while the save runs stay in the journal
+  this->journalMark = this->journal.mark();
+  this->journalBase = this->canvas->getShapeCount();
 
+  this->canvas->releaseSceneFile(path);
+  this->saver->save(path, this->canvas->snapshot(), this->saveWithJson);
+  this->statusBar()->showMessage(
+    tr("Saving %1...").arg(QFileInfo{path}.fileName()));
+  return true;
+}
+
+void MainWindow::saveProgress(const QString& path, const int percent)
+{
   this->statusBar()->showMessage(
-    "Save as operation has been completed successfully");
+    tr("Saving %1... %2%").arg(QFileInfo{path}.fileName()).arg(percent));
+}
+
+void MainWindow::saveFinished(const QString& path, const bool ok)
+{
+  if (ok)
+  {
+    this->journal.compact(this->journalMark, this->journalBase, path);
+    this->statusBar()->showMessage(
+      tr("Saved %1 successfully").arg(QFileInfo{path}.fileName()));
+  }
+  else
+  {
+    this->statusBar()->clearMessage();
+    QMessageBox::warning(
+      this, tr("Save failed"), tr("Cannot save %1.").arg(path));
+  }
+
+  if (this->closeRequested)
+  {
+    this->close();
+  }
 }
 
 void MainWindow::exitApp()
@@ -300,12 +399,160 @@ void MainWindow::exitApp()
   this->close();
 }
 
+void MainWindow::undo()
+{
+  this->canvas->undo();
+
+  this->statusBar()->showMessage(
+    "Undo operation has been completed successfully");
+}
+
+void MainWindow::redo()
+{
+  this->canvas->redo();
+
+  this->statusBar()->showMessage(
+    "Redo operation has been completed successfully");
+}
+
 void MainWindow::closeEvent(QCloseEvent* event)
 {
-  this->saveFile();
+  // A save that is already running stands in for the one on exit; the
+  // window closes once it has finished
+  if (!this->closeRequested)
+  {
+    this->closeRequested = true;
+    if (!this->saver->isBusy())
+    {
+      this->saveFile();
+    }
+  }
+
+  if (this->saver->isBusy())
+  {
+    event->ignore();
+    return;
+  }
+  this->journal.close();
   QMainWindow::closeEvent(event);
 }
 
+void MainWindow::recordEdit(const SceneEdit& edit)
+{
+  this->journal.append(edit);
+  this->syncUndoUi();
+  if (edit.kind == SceneEdit::Kind::Settings)
+  {
+    // Undo and redo change the settings behind the toolbar
+    this->syncSettingsUi();
+  }
+
+  // Folding the journal into the drawing is a normal background save
+  if (
+    this->journal.size() > journalCompactBytes && !this->saver->isBusy() &&
+    !this->closeRequested)
+  {
+    this->saveFile();
+  }
+}
+
+void MainWindow::openJournal()
+{
+  const QString target{this->journalTarget()};
+  const qsizetype base{this->canvas->getShapeCount()};
+  const QVector<SceneEdit> edits{this->journal.open(target, base)};
+  if (edits.isEmpty())
+  {
+    return;
+  }
+
+  qsizetype applied{0};
+  while (applied < edits.size() && this->canvas->applyEdit(edits.at(applied)))
+  {
+    ++applied;
+  }
+  if (applied < edits.size())
+  {
+    // The rest does not fit the drawing, keep only what was replayed
+    this->journal.start(target, base);
+    std::ranges::for_each(
+      edits | std::views::take(applied),
+      [this](const SceneEdit& edit)
+      {
+        this->journal.append(edit);
+      });
+  }
+
+  this->canvas->update();
+  this->syncSettingsUi();
+  this->statusBar()->showMessage(
+    tr("Recovered %1 unsaved edits").arg(applied));
+}
+
+QString MainWindow::defaultFilePath() const
+{
+  const QFileInfo exeInfo{QCoreApplication::applicationFilePath()};
+  return exeInfo.dir().filePath(
+    QStringLiteral("%1.png").arg(exeInfo.completeBaseName()));
+}
+
+QString MainWindow::journalTarget() const
+{
+  // Where saveFile will write the drawing
+  return this->currentFilePath.isEmpty() ? this->defaultFilePath()
+                                         : this->currentFilePath;
+}
+
+void MainWindow::syncSettingsUi()
+{
+  QString css{
+    QString{"background-color: %1"}.arg(this->canvas->getPenColor().name())};
+  this->penColorButton->setStyleSheet(css);
+
+  css =
+    QString{"background-color: %1"}.arg(this->canvas->getFillColor().name());
+  this->fillColorButton->setStyleSheet(css);
+  this->fillCheckBox->setChecked(this->canvas->getFill());
+  this->penWidthSpinBox->setValue(this->canvas->getPenWidth());
+}
+
+void MainWindow::showStats(const bool show)
+{
+  this->canvas->setStatsVisible(show);
+}
+
+void MainWindow::exportStats()
+{
+  const QString path{QFileDialog::getSaveFileName(
+    this,
+    tr("Export stats"),
+    QString{"frame-stats.csv"},
+    tr("CSV files (*.csv)"))};
+
+  if (path.isEmpty())
+  {
+    return;
+  }
+
+  if (!this->canvas->getStats().writeCsv(path))
+  {
+    QMessageBox::warning(
+      this, tr("Export failed"), tr("Cannot write %1.").arg(path));
+    return;
+  }
+
+  this->statusBar()->showMessage(
+    tr("Exported %1 frames to %2")
+      .arg(this->canvas->getStats().size())
+      .arg(QFileInfo{path}.fileName()));
+}
+
+void MainWindow::syncUndoUi()
+{
+  this->ui->actionUndo->setEnabled(this->canvas->canUndo());
+  this->ui->actionRedo->setEnabled(this->canvas->canRedo());
+}
+
 void MainWindow::penWidthChanged(const int width)
 {
   this->canvas->setPenWidth(width);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "editjournal.hpp"
 #include "paintcanvas.hpp"
+#include "scenesaver.hpp"
 #include "ui_mainwindow.h"
 
 #include <QApplication>
@@ -42,15 +44,44 @@ private slots:
   void saveFile();
   void saveFileAs();
   void exitApp();
+  void undo();
+  void redo();
+  void showStats(const bool show);
+  void exportStats();
+
+  void saveProgress(const QString& path, const int percent);
+  void saveFinished(const QString& path, const bool ok);
+  void recordEdit(const SceneEdit& edit);
 
 private:
   void closeEvent(QCloseEvent* event) override;
+  // Hands a snapshot of the canvas to the saver, the result is reported
+  // in the status bar. Returns false if a save is still running
+  bool startSave(const QString& path);
+  // Replays what the journal of the current drawing holds beyond it and
+  // keeps journaling there
+  void openJournal();
+  QString defaultFilePath() const;
+  QString journalTarget() const;
+  void syncSettingsUi();
+  void syncUndoUi();
+
+  // Journal size that triggers a save folding it into the drawing
+  static constexpr qint64 journalCompactBytes{4 * 1024 * 1024};
 
   std::unique_ptr<Ui::MainWindow> ui{nullptr};
   PaintCanvas* canvas{nullptr};
+  SceneSaver* saver{nullptr};
   QPushButton* penColorButton{nullptr};
   QPushButton* fillColorButton{nullptr};
   QCheckBox* fillCheckBox{nullptr};
   QSpinBox* penWidthSpinBox{nullptr};
   QString currentFilePath{};
+  // Chosen in Save As: PNGs of the current file carry the JSON chunk too,
+  // so versions without the binary one can open them
+  bool saveWithJson{false};
+  bool closeRequested{false};
+  EditJournal journal{};
+  EditJournal::Mark journalMark{};
+  qsizetype journalBase{0};
 };
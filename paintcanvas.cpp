@@ -1,8 +1,42 @@
 #include "paintcanvas.hpp"
+#include "allocationcounter.hpp"
+#include "scenefile.hpp"
+#include "traceevents.hpp"
 
 PaintCanvas::PaintCanvas(QWidget* const parent) : QWidget{parent}
 {
   this->setAcceptDrops(false);
+  this->statsTimer.setInterval(250);
+  this->connect(
+    &this->statsTimer,
+    &QTimer::timeout,
+    this,
+    [this]()
+    {
+      this->update(this->statsRect());
+    });
+  this->idleTimer.setSingleShot(true);
+  this->idleTimer.setInterval(150);
+  this->connect(
+    &this->idleTimer,
+    &QTimer::timeout,
+    this,
+    [this]()
+    {
+      this->interacting = false;
+      this->update();
+    });
+  this->connect(
+    &this->tileCache,
+    &TileCache::tileReady,
+    this,
+    [this](const int level, const QRect& rect)
+    {
+      if (level == this->zoomLevel)
+      {
+        this->update(rect.translated(this->pan.toPoint()));
+      }
+    });
   this->update();
 }
 
@@ -14,6 +48,9 @@ PaintCanvas::ToolType PaintCanvas::getTool() const
 void PaintCanvas::setTool(const ToolType& newTool)
 {
   this->tool = newTool;
+
+  // Previews of the old tool may still be on screen
+  this->update();
 }
 
 bool PaintCanvas::getFill() const
@@ -23,7 +60,15 @@ bool PaintCanvas::getFill() const
 
 void PaintCanvas::setFill(const bool newFill)
 {
-  this->fill = newFill;
+  if (newFill == this->fill)
+  {
+    return;
+  }
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Settings;
+  edit.settings = this->sceneSettings();
+  edit.settings.fill = newFill;
+  this->commitEdit(edit);
 }
 
 bool PaintCanvas::isDrawingEnabled() const
@@ -43,7 +88,15 @@ int PaintCanvas::getPenWidth() const
 
 void PaintCanvas::setPenWidth(const int newPenWidth)
 {
-  this->penWidth = newPenWidth;
+  if (newPenWidth == this->penWidth)
+  {
+    return;
+  }
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Settings;
+  edit.settings = this->sceneSettings();
+  edit.settings.penWidth = newPenWidth;
+  this->commitEdit(edit);
 }
 
 QColor PaintCanvas::getFillColor() const
@@ -53,7 +106,15 @@ QColor PaintCanvas::getFillColor() const
 
 void PaintCanvas::setFillColor(const QColor& newFillColor)
 {
-  this->fillColor = newFillColor;
+  if (newFillColor == this->fillColor)
+  {
+    return;
+  }
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Settings;
+  edit.settings = this->sceneSettings();
+  edit.settings.fillColor = newFillColor;
+  this->commitEdit(edit);
 }
 
 QColor PaintCanvas::getPenColor() const
@@ -63,7 +124,15 @@ QColor PaintCanvas::getPenColor() const
 
 void PaintCanvas::setPenColor(const QColor& newPenColor)
 {
-  this->penColor = newPenColor;
+  if (newPenColor == this->penColor)
+  {
+    return;
+  }
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Settings;
+  edit.settings = this->sceneSettings();
+  edit.settings.penColor = newPenColor;
+  this->commitEdit(edit);
 }
 
 QPointF PaintCanvas::getLastPoint() const
@@ -98,12 +167,16 @@ void PaintCanvas::setImage(const QImage& newImage)
 
 void PaintCanvas::resizeImage(QImage* const image, const QSize& newSize)
 {
-  if (image->size() == newSize)
+  const qreal dpr{this->devicePixelRatioF()};
+  if (
+    image->deviceIndependentSize().toSize() == newSize &&
+    image->devicePixelRatio() == dpr)
   {
     return;
   }
 
-  QImage newImage{newSize, QImage::Format_RGB32};
+  QImage newImage{newSize * dpr, QImage::Format_RGB32};
+  newImage.setDevicePixelRatio(dpr);
   newImage.fill(qRgb(255, 255, 255));
   QPainter painter(&newImage);
   painter.drawImage(QPoint(0, 0), *image);
@@ -157,36 +230,44 @@ bool PaintCanvas::isImage(const QString& fullpath) const
 void PaintCanvas::mousePressEvent(QMouseEvent* event)
 {
   event->accept();
+  this->markInteracting();
+  if (this->panKeyDown && event->button() == Qt::LeftButton)
+  {
+    this->panning = true;
+    this->panFrom = event->position();
+    this->setCursor(Qt::ClosedHandCursor);
+    return;
+  }
+
+  const QPointF pos{this->toScene(event->position())};
+  const QRect before{this->overlayBounds()};
+  // Everything one gesture changes is undone in one step
+  this->history.beginGroup();
   this->setFocus();
-  this->setLastPos(event->pos());
+  this->setLastPos(pos);
 
   if (this->getTool() == ToolType::Modify)
   {
     const bool ctrl{event->modifiers().testFlag(Qt::ControlModifier)};
-    const bool anySelected{std::ranges::any_of(
-      this->shapes,
-      [](const Shape& s)
-      {
-        return s.isSelected;
-      })};
+    const bool anySelected{this->anySelected()};
 
     if (event->button() == Qt::LeftButton)
     {
-      Shape* const hit{topHit(event->pos())};
-      if (hit != nullptr)
+      const int hit{this->timedTopHit(pos)};
+      if (hit >= 0)
       {
-        const bool keepGroup{hit->isSelected && !ctrl};
+        const bool keepGroup{this->shapes.isSelected(hit) && !ctrl};
         if (!keepGroup)
         {
-          selectShape(*hit, ctrl);
+          this->selectShape(hit, ctrl);
         }
-        this->setMoved(hit->isSelected);
-        this->setDragStart(event->pos());
+        this->setMoved(this->shapes.isSelected(hit));
+        this->setDragStart(pos);
       }
       else
       {
         this->setSelected(true);
-        this->setSelectionStart(event->pos());
+        this->setSelectionStart(pos);
         this->setSelectionRect(
           QRectF{this->getSelectionStart(), this->getSelectionStart()});
         if (!ctrl)
@@ -197,38 +278,38 @@ void PaintCanvas::mousePressEvent(QMouseEvent* event)
     }
     else if (event->button() == Qt::RightButton)
     {
-      Shape* const hit{topHit(event->pos())};
-      if (hit != nullptr)
+      const int hit{this->timedTopHit(pos)};
+      if (hit >= 0)
       {
-        const bool keepGroup{hit->isSelected && !ctrl};
+        const bool keepGroup{this->shapes.isSelected(hit) && !ctrl};
         if (!keepGroup)
         {
-          selectShape(*hit, ctrl);
+          this->selectShape(hit, ctrl);
         }
         this->setRotated(true);
-        this->setRotateAnchor(event->pos());
+        this->setRotateAnchor(pos);
       }
       else if (anySelected)
       {
         this->setRotated(true);
-        this->setRotateAnchor(event->pos());
+        this->setRotateAnchor(pos);
       }
     }
     else if (event->button() == Qt::MiddleButton)
     {
-      Shape* const hit{topHit(event->pos())};
-      if (hit != nullptr)
+      const int hit{this->timedTopHit(pos)};
+      if (hit >= 0)
       {
-        const bool keepGroup{hit->isSelected && !ctrl};
+        const bool keepGroup{this->shapes.isSelected(hit) && !ctrl};
         if (!keepGroup)
         {
-          selectShape(*hit, ctrl);
+          this->selectShape(hit, ctrl);
         }
       }
-      if (anySelected || hit != nullptr)
+      if (anySelected || hit >= 0)
       {
         this->setCloned(true);
-        this->setDragStart(event->pos());
+        this->setDragStart(pos);
         this->setClonesCreated(false);
       }
     }
@@ -237,10 +318,10 @@ void PaintCanvas::mousePressEvent(QMouseEvent* event)
   {
     if (event->button() == Qt::LeftButton)
     {
-      this->trianglePoints.push_back(event->pos());
+      this->trianglePoints.push_back(pos);
       if (this->trianglePoints.size() == 3)
       {
-        this->shapes.push_back(makeTriangleShape(this->trianglePoints));
+        this->createShape(this->makeTriangleShape(this->trianglePoints));
         this->trianglePoints.clear();
       }
     }
@@ -250,18 +331,35 @@ void PaintCanvas::mousePressEvent(QMouseEvent* event)
     if (event->button() == Qt::LeftButton)
     {
       this->setDrawingEnabled(true);
-      this->setLastPoint(event->pos());
+      this->setLastPoint(pos);
     }
   }
 
-  this->update();
+  this->update(this->toView(before | this->overlayBounds()));
 }
 
 void PaintCanvas::mouseReleaseEvent(QMouseEvent* event)
 {
   event->accept();
+  // The result of the gesture is refined once the input rests
+  this->markInteracting();
+  if (this->panning)
+  {
+    if (event->button() == Qt::LeftButton)
+    {
+      this->panning = false;
+      this->setCursor(this->panKeyDown ? Qt::OpenHandCursor : Qt::ArrowCursor);
+    }
+    return;
+  }
+
+  const QPointF pos{this->toScene(event->position())};
+  const QRect before{this->overlayBounds()};
   if (this->getTool() == ToolType::Modify)
   {
+    this->commitPendingTransform();
+    this->layerValid = false;
+
     if (event->button() == Qt::LeftButton)
     {
       if (this->isSelected())
@@ -275,10 +373,12 @@ void PaintCanvas::mouseReleaseEvent(QMouseEvent* event)
         {
           this->clearSelections();
         }
-        Shape* const hit{topHit(event->pos())};
-        if (hit != nullptr)
+        const int hit{this->timedTopHit(pos)};
+        if (hit >= 0)
         {
-          selectShape(*hit, event->modifiers().testFlag(Qt::ControlModifier));
+          this->selectShape(
+            hit,
+            event->modifiers().testFlag(Qt::ControlModifier));
         }
       }
       this->setSelected(false);
@@ -300,49 +400,68 @@ void PaintCanvas::mouseReleaseEvent(QMouseEvent* event)
     {
       if (this->getTool() == ToolType::Rect)
       {
-        this->shapes.push_back(this->makeRectShape(
+        this->createShape(this->makeRectShape(
           this->getLastPoint(),
-          event->pos(),
+          pos,
           ToolType::Rect));
       }
       else if (this->getTool() == ToolType::Square)
       {
-        this->shapes.push_back(
-          this->makeSquareShape(this->getLastPoint(), event->pos()));
+        this->createShape(
+          this->makeSquareShape(this->getLastPoint(), pos));
       }
       else if (this->getTool() == ToolType::Ellipse)
       {
-        this->shapes.push_back(
-          this->makeEllipseShape(this->getLastPoint(), event->pos()));
+        this->createShape(
+          this->makeEllipseShape(this->getLastPoint(), pos));
       }
       this->setDrawingEnabled(false);
     }
   }
 
-  this->update();
+  this->history.endGroup();
+  this->update(this->toView(before | this->overlayBounds()));
 }
 
 void PaintCanvas::mouseMoveEvent(QMouseEvent* event)
 {
   event->accept();
-  this->setLastPos(event->pos());
+  if (event->buttons() != Qt::NoButton)
+  {
+    this->markInteracting();
+  }
+  if (this->panning)
+  {
+    this->setPan(this->pan + event->position() - this->panFrom);
+    this->panFrom = event->position();
+    return;
+  }
+
+  const QPointF pos{this->toScene(event->position())};
+  const QRect before{this->overlayBounds()};
+  this->setLastPos(pos);
 
   if (this->getTool() == ToolType::Modify)
   {
     if (this->isMoved() && event->buttons().testFlag(Qt::LeftButton))
     {
-      const QPointF delta{event->pos() - this->getDragStart()};
-      this->moveSelected(delta);
-      this->setDragStart(event->pos());
+      if (!(this->layerValid))
+      {
+        this->renderStaticLayer();
+      }
+      this->moveSelected(pos - this->getDragStart());
     }
     else if (this->isSelected() && event->buttons().testFlag(Qt::LeftButton))
     {
-      this->setSelectionRect(QRectF{this->getSelectionStart(), event->pos()});
+      this->setSelectionRect(QRectF{this->getSelectionStart(), pos});
     }
     else if (this->isRotated() && event->buttons().testFlag(Qt::RightButton))
     {
-      this->rotateSelected(this->getRotateAnchor(), event->pos());
-      this->setRotateAnchor(event->pos());
+      if (!(this->layerValid))
+      {
+        this->renderStaticLayer();
+      }
+      this->rotateSelected(this->getRotateAnchor(), pos);
     }
     else if (this->isCloned() && event->buttons().testFlag(Qt::MiddleButton))
     {
@@ -351,64 +470,120 @@ void PaintCanvas::mouseMoveEvent(QMouseEvent* event)
         this->cloneSelected();
         this->setClonesCreated(true);
       }
-      const QPointF delta{event->pos() - this->getDragStart()};
-      this->moveSelected(delta);
-      this->setDragStart(event->pos());
+      if (!(this->layerValid))
+      {
+        this->renderStaticLayer();
+      }
+      this->moveSelected(pos - this->getDragStart());
     }
   }
 
-  this->update();
+  this->update(this->toView(before | this->overlayBounds()));
 }
 
 void PaintCanvas::paintEvent(QPaintEvent* event)
 {
+  const TraceSpan span{"paintEvent", "paint"};
   event->accept();
+  QElapsedTimer timer{};
+  timer.start();
   QPainter p{this};
-  p.fillRect(this->rect(), Qt::white);
+  const qint64 allocationsBefore{AllocationCounter::count()};
+  int drawn{0};
+  const auto inRegion = [this, event](const int i)
+  {
+    return event->region().intersects(this->toView(this->paintBounds(i)));
+  };
 
-  // Some latest C++
-  std::ranges::for_each(
-    this->shapes,
-    [this, &p](const auto& s)
-    {
-      QPainterPath path{this->shapePath(s)};
-      QPen pen{s.pen, static_cast<qreal>(s.width)};
-      pen.setCapStyle(Qt::RoundCap);
-      pen.setJoinStyle(Qt::RoundJoin);
-      p.setPen(pen);
-      if (this->getFill())
-      {
-        p.setBrush(s.fill);
-      }
-      else
-      {
-        p.setBrush(Qt::NoBrush);
-      }
-      p.drawPath(path);
-      if (s.isSelected)
+  if (this->layerValid)
+  {
+    // Static shapes come from the retained layer, only the moving selection
+    // is rasterized again. It is drawn on top until the gesture ends
+    const QRect r{event->rect()};
+    const qreal dpr{this->image.devicePixelRatio()};
+    p.drawImage(
+      QRectF{r},
+      this->image,
+      QRectF{r.x() * dpr, r.y() * dpr, r.width() * dpr, r.height() * dpr});
+
+    p.setTransform(this->viewTransform());
+    this->paintStyles.setView(
+      this->size(),
+      this->zoom,
+      this->pan,
+      this->devicePixelRatioF(),
+      this->interacting);
+    QVector<int>& visible{this->visibleScratch};
+    visible.clear();
+    visible.append(this->shapes.selection());
+    std::ranges::sort(visible);
+    std::ranges::for_each(
+      visible | std::views::filter(inRegion),
+      [this, &p, &drawn](const int i)
       {
-        QPen dashPen{Qt::DashLine};
-        dashPen.setColor(Qt::blue);
-        p.setPen(dashPen);
-        p.setBrush(Qt::NoBrush);
-        p.drawRect(path.boundingRect());
-      }
+        this->drawShape(p, i);
+        ++drawn;
+      });
+  }
+  else
+  {
+    // Tiles hold the committed scene at full quality, a selection in
+    // flight is not where they show it. What they do not cover yet is drawn
+    // shape by shape without antialiasing and, once input is idle, rendered
+    // to replace the preview
+    const bool tiled{!this->transformPending};
+    const QPoint origin{this->pan.toPoint()};
+    const qreal dpr{this->devicePixelRatioF()};
+    QRegion dirty{event->region()};
+    if (tiled)
+    {
+      dirty = this->tileCache.draw(p, dirty, this->zoomLevel, origin, dpr);
+    }
+    if (!dirty.isEmpty())
+    {
+      this->paintScene(p, dirty, drawn);
+    }
+    if (tiled && !dirty.isEmpty() && !this->interacting)
+    {
+      // After drawing, so the paths built for it are not copied away from
+      // the store once the workers share it
+      this->tileCache.request(
+        dirty.boundingRect(),
+        this->zoomLevel,
+        origin,
+        dpr,
+        this->tileScene());
+    }
+  }
+  p.setTransform(this->viewTransform());
+
+  // Shapes keep their drawing order, it decides what covers what, so only
+  // the frames can be grouped: all of them after the shapes with one pen
+  // instead of switching pens at every selected shape
+  std::ranges::for_each(
+    this->shapes.selection() | std::views::filter(inRegion),
+    [this, &p](const int i)
+    {
+      this->drawSelectionFrame(p, i);
     });
 
+  // Built once, setting them is only a reference count. Zero width pens
+  // are cosmetic, one pixel at any zoom
+  static const QPen rubberBandPen{QColor{Qt::darkGray}, 0.0, Qt::DashLine};
+  static const QBrush rubberBandBrush{QColor{0, 0, 255, 30}};
+  static const QPen previewPen{QColor{Qt::darkGreen}, 0.0, Qt::DashLine};
+  static const QBrush previewBrush{QColor{0, 255, 0, 30}};
+
   if (this->getTool() == ToolType::Modify && this->isSelected())
   {
-    QPen dashPen{Qt::DashLine};
-    dashPen.setColor(Qt::darkGray);
-    p.setPen(dashPen);
-    p.setBrush(QColor(0, 0, 255, 30));
+    p.setPen(rubberBandPen);
+    p.setBrush(rubberBandBrush);
     p.drawRect(this->getSelectionRect());
   }
 
   if (
     this->getTool() == ToolType::Triangle && !(this->trianglePoints.isEmpty()))
   {
-    QPen previewPen{Qt::DashLine};
-    previewPen.setColor(Qt::darkGreen);
     p.setPen(previewPen);
     p.setBrush(Qt::NoBrush);
     if (this->trianglePoints.size() == 1)
@@ -427,39 +602,49 @@ void PaintCanvas::paintEvent(QPaintEvent* event)
     (this->getTool() == ToolType::Rect || this->getTool() == ToolType::Square ||
      this->getTool() == ToolType::Ellipse))
   {
-    QPen previewPen{Qt::DashLine};
-    previewPen.setColor(Qt::darkGreen);
     p.setPen(previewPen);
-    p.setBrush(QColor(0, 255, 0, 30));
-    if (this->getTool() == ToolType::Rect)
+    p.setBrush(previewBrush);
+    if (this->getTool() == ToolType::Ellipse)
     {
-      p.drawRect(QRectF{this->getLastPoint(), this->getLastPos()});
+      p.drawEllipse(this->drawingPreviewRect());
     }
-    else if (this->getTool() == ToolType::Square)
-    {
-      const Shape sq{
-        this->makeSquareShape(this->getLastPoint(), this->getLastPos())};
-      p.drawRect(QRectF{sq.points.at(0), sq.points.at(1)});
-    }
-    else if (this->getTool() == ToolType::Ellipse)
+    else
     {
-      const Shape el{
-        this->makeEllipseShape(this->getLastPoint(), this->getLastPos())};
-      p.drawEllipse(QRectF{el.points.at(0), el.points.at(1)});
+      p.drawRect(this->drawingPreviewRect());
     }
   }
+
+  // Refreshing the panel alone is not a frame of the scene, and the panel
+  // is drawn after the time is taken
+  if (!this->statsVisible || !this->statsRect().contains(event->rect()))
+  {
+    this->stats.addFrame(
+      timer.nsecsElapsed(),
+      AllocationCounter::count() - allocationsBefore,
+      drawn,
+      static_cast<int>(this->shapes.size()) - drawn,
+      static_cast<int>(this->shapes.selectionSize()));
+  }
+  if (this->statsVisible && event->region().intersects(this->statsRect()))
+  {
+    p.resetTransform();
+    this->drawStats(p);
+  }
 }
 
 void PaintCanvas::resizeEvent(QResizeEvent* event)
 {
   event->accept();
 
+  // The retained layer no longer covers the whole widget
+  this->layerValid = false;
+
+  const QSize imageSize{this->getImage().deviceIndependentSize().toSize()};
   if (
-    this->width() > this->getImage().width() ||
-    this->height() > this->getImage().height())
+    this->width() > imageSize.width() || this->height() > imageSize.height())
   {
-    const int newWidth{qMax(this->width() + 128, this->getImage().width())};
-    const int newHeight{qMax(this->height() + 128, this->getImage().height())};
+    const int newWidth{qMax(this->width() + 128, imageSize.width())};
+    const int newHeight{qMax(this->height() + 128, imageSize.height())};
     this->resizeImage(&this->image, QSize{newWidth, newHeight});
     this->update();
   }
@@ -473,36 +658,76 @@ void PaintCanvas::keyPressEvent(QKeyEvent* event)
   {
     event->accept();
 
+    const QRect before{this->overlayBounds()};
     this->deleteSelected();
-    this->update();
+    this->update(this->toView(before));
 
     return;
   }
+  if (event->key() == Qt::Key_Space && !event->isAutoRepeat())
+  {
+    event->accept();
+    this->panKeyDown = true;
+    if (!this->panning)
+    {
+      this->setCursor(Qt::OpenHandCursor);
+    }
+    return;
+  }
 
   QWidget::keyPressEvent(event);
 }
 
-PaintCanvas::Shape PaintCanvas::makeRectShape(
+void PaintCanvas::keyReleaseEvent(QKeyEvent* event)
+{
+  if (event->key() == Qt::Key_Space && !event->isAutoRepeat())
+  {
+    event->accept();
+    this->panKeyDown = false;
+    if (!this->panning)
+    {
+      this->setCursor(Qt::ArrowCursor);
+    }
+    return;
+  }
+
+  QWidget::keyReleaseEvent(event);
+}
+
+void PaintCanvas::wheelEvent(QWheelEvent* event)
+{
+  event->accept();
+  this->markInteracting();
+  // One notch of a common wheel is 120 and a level. Finer wheels and touch
+  // pads add up until they make one
+  this->wheelDelta += event->angleDelta().y();
+  const int steps{this->wheelDelta / 120};
+  this->wheelDelta -= steps * 120;
+  if (steps != 0)
+  {
+    this->setZoomLevel(this->zoomLevel + steps, event->position());
+  }
+}
+
+Shape PaintCanvas::makeRectShape(
   const QPointF& a, const QPointF& b, const ToolType& t) const
 {
   Shape s{};
 
-  s.type = t;
+  s.type = static_cast<ShapeType>(t);
   QRectF r{a, b};
   s.points = {r.topLeft(), r.bottomRight()};
-  s.pen = this->getPenColor();
-  s.fill = this->getFillColor();
-  s.width = this->getPenWidth();
+  s.style = this->currentStyle();
 
   return s;
 }
 
-PaintCanvas::Shape
+Shape
 PaintCanvas::makeSquareShape(const QPointF& center, const QPointF& cursor) const
 {
   Shape s{};
 
-  s.type = ToolType::Square;
+  s.type = ShapeType::Square;
   const qreal dist{QLineF{center, cursor}.length()};
   const qreal side{dist / 2.0};
   const qreal half{side / 2.0};
@@ -510,141 +735,390 @@ PaintCanvas::makeSquareShape(const QPointF& center, const QPointF& cursor) const
     QPointF{center.x() - half, center.y() - half},
     QPointF{center.x() + half, center.y() + half}};
   s.points = {r.topLeft(), r.bottomRight()};
-  s.pen = this->getPenColor();
-  s.fill = this->getFillColor();
-  s.width = this->getPenWidth();
+  s.style = this->currentStyle();
 
   return s;
 }
 
-PaintCanvas::Shape PaintCanvas::makeEllipseShape(
+Shape PaintCanvas::makeEllipseShape(
   const QPointF& center, const QPointF& cursor) const
 {
   Shape s{};
 
-  s.type = ToolType::Ellipse;
+  s.type = ShapeType::Ellipse;
   const qreal radius{QLineF{center, cursor}.length()};
   QRectF r{
     QPointF{center.x() - radius, center.y() - radius},
     QPointF{center.x() + radius, center.y() + radius}};
   s.points = {r.topLeft(), r.bottomRight()};
-  s.pen = this->getPenColor();
-  s.fill = this->getFillColor();
-  s.width = this->getPenWidth();
+  s.style = this->currentStyle();
 
   return s;
 }
 
-PaintCanvas::Shape
-PaintCanvas::makeTriangleShape(const QVector<QPointF>& pts) const
+Shape PaintCanvas::makeTriangleShape(const QVector<QPointF>& pts) const
 {
-  Shape s;
+  Shape s{};
 
-  s.type = ToolType::Triangle;
-  s.points = pts;
-  s.pen = this->getPenColor();
-  s.fill = this->getFillColor();
-  s.width = this->getPenWidth();
+  s.type = ShapeType::Triangle;
+  std::ranges::copy(pts | std::views::take(Shape::maxPoints), s.points.begin());
+  s.style = this->currentStyle();
 
   return s;
 }
 
-QPainterPath PaintCanvas::shapePath(const Shape& s) const
+ShapeStyle PaintCanvas::currentStyle() const
+{
+  ShapeStyle style{};
+  style.pen = this->getPenColor();
+  style.fill = this->getFillColor();
+  style.width = this->getPenWidth();
+  return style;
+}
+
+const QPainterPath& PaintCanvas::shapePath(const int i) const
 {
-  QPainterPath path{};
+  return this->shapes.path(i);
+}
 
-  if (s.type == ToolType::Triangle && s.points.size() == 3)
+QRectF PaintCanvas::shapeBounds(const int i) const
+{
+  if (this->isPending(i))
   {
-    path.moveTo(s.points.at(0));
-    path.lineTo(s.points.at(1));
-    path.lineTo(s.points.at(2));
-    path.closeSubpath();
+    // Box around the turned box, slightly loose until the gesture is baked
+    return this->pendingTransform(i).mapRect(this->shapes.bounds(i));
   }
-  else if (
-    (s.type == ToolType::Rect || s.type == ToolType::Square ||
-     s.type == ToolType::Ellipse) &&
-    s.points.size() >= 2)
+  return this->shapes.bounds(i);
+}
+
+QPointF PaintCanvas::shapeCenter(const int i) const
+{
+  if (this->isPending(i))
   {
-    QRectF r{s.points.at(0), s.points.at(1)};
-    r = r.normalized();
-    if (s.type == ToolType::Ellipse)
-    {
-      path.addEllipse(r);
-    }
-    else
+    return this->shapes.center(i) + this->pendingOffset;
+  }
+  return this->shapes.center(i);
+}
+
+QRect PaintCanvas::paintBounds(const int i) const
+{
+  // Half the stroke plus a little room for antialiasing and the dashed frame
+  const qreal margin{this->shapes.style(i).width / 2.0 + 2.0};
+  return this->shapeBounds(i)
+    .adjusted(-margin, -margin, margin, margin)
+    .toAlignedRect();
+}
+
+QRect PaintCanvas::overlayBounds() const
+{
+  // Everything that can change between two mouse events: the selected
+  // shapes with their frames, the rubber band and the creation previews
+  QRect r{};
+
+  std::ranges::for_each(
+    this->shapes.selection(),
+    [this, &r](const int i)
     {
-      path.addRect(r);
-    }
+      r |= this->paintBounds(i);
+    });
+
+  if (this->getTool() == ToolType::Modify && this->isSelected())
+  {
+    r |= this->getSelectionRect()
+           .normalized()
+           .adjusted(-2.0, -2.0, 2.0, 2.0)
+           .toAlignedRect();
   }
 
-  const QPointF c{this->shapeCenter(s)};
-  QTransform tr{};
+  if (
+    this->getTool() == ToolType::Triangle && !(this->trianglePoints.isEmpty()))
+  {
+    QPolygonF preview{this->trianglePoints};
+    preview.push_back(this->getLastPos());
+    r |= preview.boundingRect().adjusted(-2.0, -2.0, 2.0, 2.0).toAlignedRect();
+  }
 
-  tr.translate(c.x(), c.y());
-  tr.rotateRadians(s.rotation);
-  tr.translate(-c.x(), -c.y());
+  if (this->isDrawingEnabled())
+  {
+    r |= this->drawingPreviewRect()
+           .normalized()
+           .adjusted(-2.0, -2.0, 2.0, 2.0)
+           .toAlignedRect();
+  }
+
+  return r;
+}
+
+void PaintCanvas::paintScene(QPainter& p, const QRegion& dirty, int& drawn)
+{
+  const QRect dirtyRect{dirty.boundingRect()};
+  p.setClipRegion(dirty);
+  p.fillRect(dirtyRect, Qt::white);
+  p.setTransform(this->viewTransform());
+  this->paintStyles.setView(
+    this->size(),
+    this->zoom,
+    this->pan,
+    this->devicePixelRatioF(),
+    this->interacting);
+
+  // The index holds fill bounds, widen the query so strokes poking into
+  // the dirty region are found too
+  QVector<int>& visible{this->visibleScratch};
+  const qreal margin{this->maxShapeWidth / 2.0 + 2.0 / this->zoom};
+  this->index.query(
+    this->toScene(QRectF{dirtyRect})
+      .adjusted(-margin, -margin, margin, margin),
+    visible);
+  if (visible.size() * 2 > this->shapes.size())
+  {
+    // Zoomed far out most of the scene is a candidate, counting up gives
+    // the drawing order without sorting them
+    visible.resize(this->shapes.size());
+    std::iota(visible.begin(), visible.end(), 0);
+  }
+  else
+  {
+    std::ranges::sort(visible);
+  }
+
+  if (this->transformPending)
+  {
+    // Index entries of a selection in flight are stale, draw it on top
+    // as the retained layer path does
+    erase_if(
+      visible,
+      [this](const int i)
+      {
+        return this->shapes.isSelected(i);
+      });
+    const qsizetype unselected{visible.size()};
+    visible.append(this->shapes.selection());
+    std::ranges::sort(visible | std::views::drop(unselected));
+  }
+
+  std::ranges::for_each(
+    visible |
+      std::views::filter(
+        [this, &dirty](const int i)
+        {
+          return dirty.intersects(this->toView(this->paintBounds(i)));
+        }),
+    [this, &p, &drawn](const int i)
+    {
+      this->drawShape(p, i);
+      ++drawn;
+    });
+  p.setClipping(false);
+}
 
-  return tr.map(path);
+void PaintCanvas::drawShape(QPainter& p, const int i) const
+{
+  // Zoomed out, most shapes cover a few pixels and a path each would be
+  // wasted on them
+  if (this->paintStyles.drawReduced(
+        p, this->shapes, i, this->getFill(), this->shapeBounds(i)))
+  {
+    return;
+  }
+
+  if (this->isPending(i))
+  {
+    // Not save() and restore(), they allocate a painter state per shape
+    const QTransform base{p.transform()};
+    p.setTransform(this->pendingTransform(i), true);
+    SceneSnapshot::drawShape(
+      p, this->shapes, i, this->getFill(), this->paintStyles);
+    p.setTransform(base);
+  }
+  else
+  {
+    SceneSnapshot::drawShape(
+      p, this->shapes, i, this->getFill(), this->paintStyles);
+  }
+}
+
+void PaintCanvas::drawSelectionFrame(QPainter& p, const int i) const
+{
+  static const QPen framePen{QColor{Qt::blue}, 0.0, Qt::DashLine};
+  p.setPen(framePen);
+  p.setBrush(Qt::NoBrush);
+  p.drawRect(this->shapeBounds(i));
 }
 
-QRectF PaintCanvas::shapeBounds(const Shape& s) const
+void PaintCanvas::renderStaticLayer()
 {
-  return this->shapePath(s).boundingRect();
+  const QSize imageSize{this->image.deviceIndependentSize().toSize()};
+  if (
+    imageSize.width() < this->width() || imageSize.height() < this->height() ||
+    this->image.devicePixelRatio() != this->devicePixelRatioF())
+  {
+    this->resizeImage(&this->image, this->size().expandedTo(imageSize));
+  }
+
+  this->image.fill(Qt::white);
+  QPainter p{&this->image};
+  p.setTransform(this->viewTransform());
+  // Only ever drawn for a gesture
+  this->paintStyles.setView(
+    this->size(),
+    this->zoom,
+    this->pan,
+    this->image.devicePixelRatio(),
+    true);
+
+  const QRect area{this->rect()};
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(this->shapes.size())) |
+      std::views::filter(
+        [this, &area](const int i)
+        {
+          return !this->shapes.isSelected(i) &&
+                 area.intersects(this->toView(this->paintBounds(i)));
+        }),
+    [this, &p](const int i)
+    {
+      this->drawShape(p, i);
+    });
+
+  this->layerValid = true;
 }
 
-QPointF PaintCanvas::shapeCenter(const Shape& s) const
+QRectF PaintCanvas::drawingPreviewRect() const
 {
-  if (s.type == ToolType::Triangle && s.points.size() == 3)
+  if (this->getTool() == ToolType::Square)
   {
-    return (s.points.at(0) + s.points.at(1) + s.points.at(2)) / 3.0;
+    const Shape sq{
+      this->makeSquareShape(this->getLastPoint(), this->getLastPos())};
+    return QRectF{sq.points.at(0), sq.points.at(1)};
   }
-  if (s.points.size() >= 2)
+  if (this->getTool() == ToolType::Ellipse)
   {
-    return QRectF{s.points.at(0), s.points.at(1)}.center();
+    const Shape el{
+      this->makeEllipseShape(this->getLastPoint(), this->getLastPos())};
+    return QRectF{el.points.at(0), el.points.at(1)};
   }
 
-  return QPointF{};
+  return QRectF{this->getLastPoint(), this->getLastPos()};
 }
 
-bool PaintCanvas::hitTest(const Shape& s, const QPointF& p) const
+int PaintCanvas::appendShape(const Shape& s)
 {
-  return this->shapePath(s).contains(p);
+  const int i{this->shapes.append(s)};
+  this->index.insert(i, this->shapes.bounds(i));
+  this->maxShapeWidth = qMax(this->maxShapeWidth, s.style.width);
+  this->invalidateTiles(this->shapes.bounds(i));
+  this->update(this->toView(this->paintBounds(i)));
+  return i;
 }
 
-void PaintCanvas::clearSelections()
+void PaintCanvas::reindexShape(const int i)
+{
+  // The index still has where the shape was
+  this->invalidateTiles(this->index.bounds(i));
+  this->invalidateTiles(this->shapes.bounds(i));
+  this->index.update(i, this->shapes.bounds(i));
+}
+
+void PaintCanvas::invalidateTiles(const QRectF& bounds)
+{
+  const qreal margin{this->maxShapeWidth / 2.0 + 2.0};
+  this->tileCache.invalidate(
+    bounds.adjusted(-margin, -margin, margin, margin));
+}
+
+void PaintCanvas::rebuildIndex()
 {
+  this->index.clear();
+  this->maxShapeWidth = 0;
+  this->shapes.updateBounds();
   std::ranges::for_each(
-    this->shapes,
-    [](auto& s)
+    std::views::iota(0, static_cast<int>(this->shapes.size())),
+    [this](const int i)
     {
-      s.isSelected = false;
+      this->index.insert(i, this->shapes.bounds(i));
+      this->maxShapeWidth =
+        qMax(this->maxShapeWidth, this->shapes.style(i).width);
     });
 }
 
-void PaintCanvas::selectShape(Shape& s, const bool add)
+bool PaintCanvas::hitTest(const int i, const QPointF& p) const
+{
+  if (this->isPending(i))
+  {
+    return this->shapes.hitTest(
+      i,
+      this->pendingTransform(i).inverted().map(p),
+      this->sceneHitTolerance());
+  }
+  return this->shapes.hitTest(i, p, this->sceneHitTolerance());
+}
+
+bool PaintCanvas::anySelected() const
+{
+  return this->shapes.hasSelection();
+}
+
+void PaintCanvas::clearSelections()
+{
+  this->shapes.clearSelection();
+}
+
+void PaintCanvas::selectShape(const int i, const bool add)
 {
   if (!add)
   {
     this->clearSelections();
   }
-  s.isSelected = true;
+  this->shapes.setSelected(i, true);
 }
 
-PaintCanvas::Shape* PaintCanvas::topHit(const QPointF& p)
+int PaintCanvas::topHit(const QPointF& p) const
 {
-  // Some latest C++ pipe syntax
-  const auto revView{this->shapes | std::views::reverse};
-  const auto it{std::ranges::find_if(
-    revView,
-    [this, p, &revView](const Shape& s)
-    {
-      return this->hitTest(s, p);
-    })};
-  return it == revView.cend() ? nullptr : std::addressof(*it);
+  const TraceSpan span{"topHit", "input"};
+  // The index holds fill bounds, strokes and the tolerance reach further
+  const qreal reach{this->maxShapeWidth / 2.0 + this->sceneHitTolerance()};
+  QVector<int> candidates{this->index.query(
+    QRectF{p.x() - reach, p.y() - reach, 2.0 * reach, 2.0 * reach})};
+
+  QVector<int> hits{};
+  if (this->transformPending)
+  {
+    // The index still has the selection where the gesture started
+    erase_if(
+      candidates,
+      [this](const int i)
+      {
+        return this->shapes.isSelected(i);
+      });
+    std::ranges::copy_if(
+      this->shapes.selection(),
+      std::back_inserter(hits),
+      [this, &p](const int i)
+      {
+        return this->hitTest(i, p);
+      });
+  }
+  hits.append(
+    this->shapes.hitTest(p, candidates, this->sceneHitTolerance()));
+
+  // Keys are positions in shapes, so the highest key is drawn on top
+  const auto it{std::ranges::max_element(hits)};
+  return it == hits.cend() ? -1 : *it;
+}
+
+int PaintCanvas::timedTopHit(const QPointF& p)
+{
+  QElapsedTimer timer{};
+  timer.start();
+  const int hit{this->topHit(p)};
+  this->stats.setLastHitTestNs(timer.nsecsElapsed());
+  return hit;
 }
 
 void PaintCanvas::applySelectionRect(const bool add)
 {
+  const TraceSpan span{"applySelectionRect", "input"};
   const QRectF rect{this->getSelectionRect().normalized()};
   if (!add)
   {
@@ -652,227 +1126,698 @@ void PaintCanvas::applySelectionRect(const bool add)
   }
 
   std::ranges::for_each(
-    this->shapes,
-    [this, &rect = std::as_const(rect)](auto& s)
+    this->index.query(rect),
+    [this, &rect = std::as_const(rect)](const int i)
     {
-      if (this->shapePath(s).intersects(rect) || rect.contains(shapeBounds(s)))
+      if (
+        this->shapePath(i).intersects(rect) ||
+        rect.contains(this->shapeBounds(i)))
       {
-        s.isSelected = true;
+        this->shapes.setSelected(i, true);
       }
     });
 }
 
-void PaintCanvas::moveSelected(const QPointF& delta)
+void PaintCanvas::moveSelected(const QPointF& offset)
 {
-  std::ranges::for_each(
-    this->shapes | std::views::filter(
-                     [](const Shape& s)
-                     {
-                       return s.isSelected;
-                     }),
-    [&delta = std::as_const(delta)](Shape& s)
-    {
-      std::ranges::for_each(
-        s.points,
-        [&delta = std::as_const(delta)](QPointF& p)
-        {
-          p += delta;
-        });
-    });
+  this->beginPendingTransform();
+  this->pendingOffset = offset;
 }
 
 void PaintCanvas::rotateSelected(const QPointF& start, const QPointF& now)
 {
-  QVector<Shape*> selectedShapes{};
-  QPointF center{};
+  this->beginPendingTransform();
+  if (!this->shapes.hasSelection())
+  {
+    return;
+  }
 
-  std::ranges::for_each(
-    this->shapes,
-    [this, &selectedShapes, &center](auto& s)
-    {
-      if (s.isSelected)
-      {
-        selectedShapes.push_back(&s);
-        center += this->shapeCenter(s);
-      }
-    });
+  // Every shape turns around its own center, which does not move, so the
+  // group center taken at the start of the gesture stays valid throughout
+  const QLineF a{this->pendingCenter, start};
+  const QLineF b{this->pendingCenter, now};
+  this->pendingRotation = b.angleTo(a) * M_PI / 180.0;
+}
 
-  if (selectedShapes.isEmpty())
+void PaintCanvas::beginPendingTransform()
+{
+  if (this->transformPending)
   {
     return;
   }
 
-  center /= selectedShapes.size();
-  const QLineF a{center, start};
-  const QLineF b{center, now};
-  const qreal delta = b.angleTo(a) * M_PI / 180.0;
+  this->transformPending = true;
+  this->pendingOffset = QPointF{};
+  this->pendingRotation = 0.0;
+  this->pendingCenter = QPointF{};
 
   std::ranges::for_each(
-    selectedShapes,
-    [&delta = std::as_const(delta)](auto* const s)
+    this->shapes.selection(),
+    [this](const int i)
     {
-      s->rotation += +delta;
+      this->pendingCenter += this->shapes.center(i);
     });
+  if (this->shapes.hasSelection())
+  {
+    this->pendingCenter /= this->shapes.selectionSize();
+  }
 }
 
-void PaintCanvas::cloneSelected()
+void PaintCanvas::commitPendingTransform()
 {
-  this->clones.clear();
-  QVector<Shape> newClones{};
+  if (!this->transformPending)
+  {
+    return;
+  }
 
-  std::ranges::for_each(
-    this->shapes | std::views::filter(
-                     [](const Shape& s)
-                     {
-                       return s.isSelected;
-                     }),
-    [&newClones](auto& s)
-    {
-      Shape copy{s};
-      copy.isSelected = true;
-      s.isSelected = false;
-      newClones.push_back(copy);
-    });
+  // Clear the flag first so bounds and index updates see the baked shapes
+  this->transformPending = false;
 
-  if (newClones.isEmpty())
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Transform;
+  edit.indices = this->shapes.sortedSelection();
+  edit.offset = this->pendingOffset;
+  edit.rotation = this->pendingRotation;
+  this->pendingOffset = QPointF{};
+  this->pendingRotation = 0.0;
+
+  if (
+    !edit.indices.isEmpty() &&
+    (!edit.offset.isNull() || edit.rotation != 0.0))
   {
-    return;
+    this->commitEdit(edit);
   }
+}
 
-  this->clones = newClones;
-  this->shapes.append(newClones);
+bool PaintCanvas::isPending(const int i) const
+{
+  return this->transformPending && this->shapes.isSelected(i);
 }
 
-void PaintCanvas::deleteSelected()
+QTransform PaintCanvas::pendingTransform(const int i) const
 {
-  erase_if(
-    this->shapes,
-    [](const Shape& s)
-    {
-      return s.isSelected;
-    });
+  // Same composition as baking: turn around the shape center, then move
+  const QPointF c{this->shapes.center(i)};
+  QTransform tr{};
+  tr.translate(this->pendingOffset.x(), this->pendingOffset.y());
+  tr.translate(c.x(), c.y());
+  tr.rotateRadians(this->pendingRotation);
+  tr.translate(-c.x(), -c.y());
+  return tr;
 }
 
-void PaintCanvas::clearAll()
+void PaintCanvas::cloneSelected()
 {
-  this->shapes.clear();
   this->clones.clear();
-  this->trianglePoints.clear();
-  this->setSelected(false);
-  this->setMoved(false);
-  this->setRotated(false);
-  this->setCloned(false);
-  this->setClonesCreated(false);
-  this->setSelectionRect(QRectF{});
-  this->update();
-}
 
-QJsonObject PaintCanvas::shapeToJson(const PaintCanvas::Shape& s) const
-{
-  QJsonObject obj{};
-  obj["type"] = static_cast<int>(s.type);
-  obj["rotation"] = s.rotation;
-  obj["width"] = s.width;
-  obj["pen"] = s.pen.name(QColor::HexArgb);
-  obj["fill"] = s.fill.name(QColor::HexArgb);
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Clone;
+  edit.indices = this->shapes.sortedSelection();
+  this->shapes.clearSelection();
+
+  if (edit.indices.isEmpty())
+  {
+    return;
+  }
 
-  QJsonArray pts{};
+  const int first{static_cast<int>(this->shapes.size())};
+  this->commitEdit(edit);
 
+  // The copies are appended behind everything and become the selection
   std::ranges::for_each(
-    s.points,
-    [&pts](const auto& p)
+    std::views::iota(first, static_cast<int>(this->shapes.size())),
+    [this](const int i)
     {
-      QJsonArray pt;
-      pt.append(p.x());
-      pt.append(p.y());
-      pts.append(pt);
+      this->clones.push_back(this->shapes.shape(i));
+      this->shapes.setSelected(i, true);
     });
+}
 
-  obj["points"] = pts;
-  return obj;
+void PaintCanvas::deleteSelected()
+{
+  if (!this->shapes.hasSelection())
+  {
+    return;
+  }
+
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Delete;
+  edit.indices = this->shapes.sortedSelection();
+  this->commitEdit(edit);
 }
 
-PaintCanvas::Shape PaintCanvas::jsonToShape(const QJsonObject& obj) const
+int PaintCanvas::createShape(const Shape& s)
 {
-  PaintCanvas::Shape s{};
-  s.type = static_cast<PaintCanvas::ToolType>(obj["type"].toInt());
-  s.rotation = obj["rotation"].toDouble();
-  s.width = obj["width"].toInt();
-  s.pen = QColor{obj["pen"].toString()};
-  s.fill = QColor{obj["fill"].toString()};
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Create;
+  edit.shape = s;
+  this->commitEdit(edit);
+  return static_cast<int>(this->shapes.size()) - 1;
+}
 
-  QJsonArray pts{obj["points"].toArray()};
+void PaintCanvas::commitEdit(const SceneEdit& edit)
+{
+  QElapsedTimer timer{};
+  timer.start();
 
-  std::ranges::for_each(
-    pts,
-    [&s](const auto& v)
-    {
-      const auto arr{v.toArray()};
-      if (arr.size() == 2)
+  // Undoing a clear needs the whole scene, without room for it the history
+  // cannot reach back beyond the clear
+  const qsizetype clearCost{
+    this->shapes.size() * static_cast<qsizetype>(sizeof(Shape))};
+  if (
+    edit.kind == SceneEdit::Kind::Clear && !this->history.fits(clearCost))
+  {
+    this->history.clear();
+  }
+  else
+  {
+    this->history.push(edit, this->inverseOf(edit));
+  }
+
+  this->applyEdit(edit);
+  this->stats.setLastEditNs(timer.nsecsElapsed());
+  emit this->edited(edit);
+}
+
+SceneEdit PaintCanvas::inverseOf(const SceneEdit& edit) const
+{
+  const int count{static_cast<int>(this->shapes.size())};
+
+  SceneEdit inverse{};
+  switch (edit.kind)
+  {
+  case SceneEdit::Kind::Clear:
+    inverse.kind = SceneEdit::Kind::Insert;
+    inverse.indices.reserve(count);
+    inverse.shapes.reserve(count);
+    std::ranges::for_each(
+      std::views::iota(0, count),
+      [this, &inverse](const int i)
       {
-        s.points.push_back(QPointF{arr.at(0).toDouble(), arr.at(1).toDouble()});
-      }
-    });
+        inverse.indices.push_back(i);
+        inverse.shapes.push_back(this->shapes.shape(i));
+      });
+    break;
+  case SceneEdit::Kind::Create:
+    inverse.kind = SceneEdit::Kind::Delete;
+    inverse.indices = {count};
+    break;
+  case SceneEdit::Kind::Transform:
+    // Turning and moving commute for shapes turning about their centers
+    inverse.kind = SceneEdit::Kind::Transform;
+    inverse.indices = edit.indices;
+    inverse.offset = -edit.offset;
+    inverse.rotation = -edit.rotation;
+    break;
+  case SceneEdit::Kind::Clone:
+    inverse.kind = SceneEdit::Kind::Delete;
+    std::ranges::copy(
+      std::views::iota(count, count + static_cast<int>(edit.indices.size())),
+      std::back_inserter(inverse.indices));
+    break;
+  case SceneEdit::Kind::Delete:
+    inverse.kind = SceneEdit::Kind::Insert;
+    inverse.indices = edit.indices;
+    inverse.shapes.reserve(edit.indices.size());
+    std::ranges::for_each(
+      edit.indices,
+      [this, &inverse](const int i)
+      {
+        inverse.shapes.push_back(this->shapes.shape(i));
+      });
+    break;
+  case SceneEdit::Kind::Insert:
+    inverse.kind = SceneEdit::Kind::Delete;
+    inverse.indices = edit.indices;
+    break;
+  case SceneEdit::Kind::Settings:
+    inverse.kind = SceneEdit::Kind::Settings;
+    inverse.settings = this->sceneSettings();
+    break;
+  }
+  return inverse;
+}
 
-  return s;
+void PaintCanvas::undo()
+{
+  this->commitPendingTransform();
+  this->applyHistory(this->history.undo());
 }
 
-QString PaintCanvas::toSerialized() const
+void PaintCanvas::redo()
+{
+  this->commitPendingTransform();
+  this->applyHistory(this->history.redo());
+}
+
+void PaintCanvas::applyHistory(const QVector<SceneEdit>& edits)
 {
-  QJsonArray arr{};
+  QElapsedTimer timer{};
+  timer.start();
   std::ranges::for_each(
-    this->shapes,
-    [this, &arr](const auto& s)
+    edits,
+    [this](const SceneEdit& edit)
     {
-      arr.append(this->shapeToJson(s));
+      this->applyEdit(edit);
+      emit this->edited(edit);
     });
+  this->stats.setLastEditNs(timer.nsecsElapsed());
+
+  // Positions of the clones may have changed
+  this->clones.clear();
+  this->layerValid = false;
+  this->update();
+}
 
-  QJsonObject root{};
-  root["shapes"] = arr;
-  root["fill"] = this->getFill();
-  root["penColor"] = this->getPenColor().name(QColor::HexArgb);
-  root["fillColor"] = this->getFillColor().name(QColor::HexArgb);
-  root["penWidth"] = this->getPenWidth();
+bool PaintCanvas::canUndo() const
+{
+  return this->history.canUndo();
+}
 
-  return QString::fromUtf8(QJsonDocument{root}.toJson(QJsonDocument::Compact));
+bool PaintCanvas::canRedo() const
+{
+  return this->history.canRedo();
 }
 
-void PaintCanvas::loadFromSerialized(const QString& json)
+qsizetype PaintCanvas::getUndoMemoryLimit() const
 {
-  this->shapes.clear();
-  const QJsonDocument doc{QJsonDocument::fromJson(json.toUtf8())};
-  if (doc.isObject())
+  return this->history.getMemoryLimit();
+}
+
+void PaintCanvas::setUndoMemoryLimit(const qsizetype newUndoMemoryLimit)
+{
+  this->history.setMemoryLimit(newUndoMemoryLimit);
+}
+
+qsizetype PaintCanvas::getUndoMemory() const
+{
+  return this->history.memoryUsage();
+}
+
+bool PaintCanvas::applyEdit(const SceneEdit& edit)
+{
+  // Edits may come from a file, check them before touching the scene.
+  // Inserted positions count the inserted shapes
+  const int count{static_cast<int>(
+    this->shapes.size() +
+    (edit.kind == SceneEdit::Kind::Insert ? edit.shapes.size() : 0))};
+  const bool validIndices{
+    std::ranges::all_of(
+      edit.indices,
+      [count](const int i)
+      {
+        return i >= 0 && i < count;
+      }) &&
+    std::ranges::adjacent_find(edit.indices, std::ranges::greater_equal{}) ==
+      edit.indices.cend()};
+  if (!validIndices)
   {
-    const QJsonObject root{doc.object()};
-    const QJsonArray arr{root["shapes"].toArray()};
+    return false;
+  }
 
+  switch (edit.kind)
+  {
+  case SceneEdit::Kind::Clear:
+    this->clearCanvas();
+    break;
+  case SceneEdit::Kind::Create:
+    if (
+      edit.shape.type < ShapeType::Square ||
+      edit.shape.type > ShapeType::Ellipse)
+    {
+      return false;
+    }
+    this->appendShape(edit.shape);
+    break;
+  case SceneEdit::Kind::Transform:
+    if (!edit.offset.isNull())
+    {
+      this->shapes.translate(edit.indices, edit.offset);
+    }
+    if (edit.rotation != 0.0)
+    {
+      this->shapes.rotate(edit.indices, edit.rotation);
+    }
+    this->shapes.updateBounds();
     std::ranges::for_each(
-      arr,
-      [this](const auto& v)
+      edit.indices,
+      [this](const int i)
       {
-        if (v.isObject())
-        {
-          this->shapes.push_back(this->jsonToShape(v.toObject()));
-        }
+        this->reindexShape(i);
       });
-
-    if (root.contains("fill"))
+    break;
+  case SceneEdit::Kind::Clone:
+    std::ranges::for_each(
+      edit.indices,
+      [this](const int i)
+      {
+        this->appendShape(this->shapes.shape(i));
+      });
+    break;
+  case SceneEdit::Kind::Delete:
+    std::ranges::for_each(
+      edit.indices,
+      [this](const int i)
+      {
+        this->invalidateTiles(this->shapes.bounds(i));
+      });
+    this->shapes.remove(edit.indices);
+    if (
+      !edit.indices.isEmpty() &&
+      edit.indices.first() == this->shapes.size() &&
+      edit.indices.last() == count - 1)
     {
-      this->setFill(root["fill"].toBool(this->getFill()));
+      // Only the tail went, as when a create or clone is undone
+      std::ranges::for_each(
+        edit.indices,
+        [this](const int i)
+        {
+          this->index.remove(i);
+        });
     }
-    if (root.contains("penColor"))
+    else
     {
-      this->setPenColor(QColor{root["penColor"].toString()});
+      // Removal shifts every following position, re-key the whole index
+      this->rebuildIndex();
     }
-    if (root.contains("fillColor"))
+    break;
+  case SceneEdit::Kind::Insert:
+  {
+    const bool validShapes{
+      edit.shapes.size() == edit.indices.size() &&
+      std::ranges::all_of(
+        edit.shapes,
+        [](const Shape& s)
+        {
+          return s.type >= ShapeType::Square && s.type <= ShapeType::Ellipse;
+        })};
+    if (!validShapes)
     {
-      this->setFillColor(QColor{root["fillColor"].toString()});
+      return false;
     }
-    if (root.contains("penWidth"))
+    const qsizetype before{this->shapes.size()};
+    this->shapes.insert(edit.indices, edit.shapes);
+    if (edit.indices.isEmpty() || edit.indices.first() >= before)
+    {
+      // Appended behind everything, nothing moved
+      this->shapes.updateBounds();
+      std::ranges::for_each(
+        edit.indices,
+        [this](const int i)
+        {
+          this->index.insert(i, this->shapes.bounds(i));
+          this->maxShapeWidth =
+            qMax(this->maxShapeWidth, this->shapes.style(i).width);
+        });
+    }
+    else
     {
-      this->setPenWidth(root["penWidth"].toInt(this->getPenWidth()));
+      this->rebuildIndex();
     }
+    std::ranges::for_each(
+      edit.indices,
+      [this](const int i)
+      {
+        this->invalidateTiles(this->shapes.bounds(i));
+      });
+    break;
+  }
+  case SceneEdit::Kind::Settings:
+    this->applySceneSettings(edit.settings);
+    break;
+  default:
+    return false;
   }
+  return true;
+}
+
+void PaintCanvas::clearAll()
+{
+  SceneEdit edit{};
+  edit.kind = SceneEdit::Kind::Clear;
+  this->commitEdit(edit);
+}
+
+void PaintCanvas::clearCanvas()
+{
+  this->shapes.clear();
+  this->index.clear();
+  this->maxShapeWidth = 0;
+  this->layerValid = false;
+  this->tileCache.clear();
+  this->transformPending = false;
+  this->clones.clear();
+  this->trianglePoints.clear();
+  this->setSelected(false);
+  this->setMoved(false);
+  this->setRotated(false);
+  this->setCloned(false);
+  this->setClonesCreated(false);
+  this->setSelectionRect(QRectF{});
+  this->update();
+}
+
+QString PaintCanvas::toSerialized() const
+{
+  const TraceSpan span{"toSerialized", "io"};
+  return SceneCodec::toJson(this->shapes, this->sceneSettings());
+}
+
+void PaintCanvas::loadFromSerialized(const QString& json)
+{
+  const TraceSpan span{"loadFromSerialized", "io"};
+  this->resetScene();
+  SceneCodec::Settings settings{this->sceneSettings()};
+  if (SceneCodec::fromJson(json, this->shapes, settings))
+  {
+    this->applySceneSettings(settings);
+  }
+  this->rebuildIndex();
+}
+
+QByteArray PaintCanvas::toBinary() const
+{
+  return SceneCodec::toCbor(this->shapes, this->sceneSettings());
+}
+
+bool PaintCanvas::loadFromBinary(const QByteArray& cbor)
+{
+  const TraceSpan span{"loadFromBinary", "io"};
+  this->resetScene();
+  SceneCodec::Settings settings{this->sceneSettings()};
+  const bool loaded{SceneCodec::fromCbor(cbor, this->shapes, settings)};
+  if (loaded)
+  {
+    this->applySceneSettings(settings);
+  }
+  this->rebuildIndex();
+  return loaded;
+}
+
+void PaintCanvas::writeToImage(QImage& img, const bool withJson) const
+{
+  this->snapshot().writeToImage(img, withJson);
+}
+
+void PaintCanvas::loadFromImage(const QImage& img)
+{
+  const QString binary{img.text(SceneCodec::binaryKey)};
+  if (
+    binary.isEmpty() ||
+    !this->loadFromBinary(QByteArray::fromBase64(binary.toLatin1())))
+  {
+    this->loadFromSerialized(img.text(SceneCodec::jsonKey));
+  }
+}
+
+bool PaintCanvas::saveSceneFile(const QString& path)
+{
+  this->releaseSceneFile(path);
+  return SceneFile::save(path, this->shapes, this->sceneSettings());
+}
+
+void PaintCanvas::releaseSceneFile(const QString& path)
+{
+  // Replacing the file the columns still view is not allowed everywhere
+  if (
+    this->shapes.isMapped() &&
+    QFileInfo{path}.absoluteFilePath() == this->mappedPath)
+  {
+    this->shapes.detach();
+  }
+}
+
+bool PaintCanvas::openSceneFile(const QString& path)
+{
+  this->resetScene();
+  SceneCodec::Settings settings{this->sceneSettings()};
+  const bool loaded{SceneFile::open(path, this->shapes, settings)};
+  if (loaded)
+  {
+    this->applySceneSettings(settings);
+    this->mappedPath = QFileInfo{path}.absoluteFilePath();
+  }
+  this->rebuildIndex();
+  return loaded;
+}
+
+SceneCodec::Settings PaintCanvas::sceneSettings() const
+{
+  SceneCodec::Settings settings{};
+  settings.fill = this->getFill();
+  settings.penColor = this->getPenColor();
+  settings.fillColor = this->getFillColor();
+  settings.penWidth = this->getPenWidth();
+  return settings;
+}
+
+void PaintCanvas::applySceneSettings(const SceneCodec::Settings& settings)
+{
+  // Loading and replaying set these, neither is a new edit. Only the fill
+  // flag shows in shapes already drawn
+  if (settings.fill != this->fill)
+  {
+    this->tileCache.clear();
+  }
+  this->fill = settings.fill;
+  this->penColor = settings.penColor;
+  this->fillColor = settings.fillColor;
+  this->penWidth = settings.penWidth;
+
+  // The fill flag applies to every shape
+  this->layerValid = false;
+  this->update();
+}
+
+void PaintCanvas::resetScene()
+{
+  this->history.clear();
+  this->shapes.clear();
+  this->index.clear();
+  this->layerValid = false;
+  this->tileCache.clear();
+  this->transformPending = false;
+}
+
+qreal PaintCanvas::getHitTolerance() const
+{
+  return this->hitTolerance;
+}
+
+void PaintCanvas::setHitTolerance(const qreal newHitTolerance)
+{
+  this->hitTolerance = qMax(0.0, newHitTolerance);
+}
+
+qreal PaintCanvas::sceneHitTolerance() const
+{
+  return this->getHitTolerance() / this->zoom;
+}
+
+qreal PaintCanvas::getZoom() const
+{
+  return this->zoom;
+}
+
+void PaintCanvas::setZoom(const qreal newZoom, const QPointF& anchor)
+{
+  const qreal clamped{qBound(minZoom, newZoom, maxZoom)};
+  this->setZoomLevel(
+    qRound(std::log2(clamped) * TileCache::levelsPerOctave), anchor);
+}
+
+void PaintCanvas::setZoomLevel(const int level, const QPointF& anchor)
+{
+  const int clamped{qBound(minZoomLevel, level, maxZoomLevel)};
+  if (clamped == this->zoomLevel)
+  {
+    return;
+  }
+  const QPointF fixed{this->toScene(anchor)};
+  this->zoomLevel = clamped;
+  this->zoom = TileCache::levelZoom(clamped);
+  this->setPan(anchor - fixed * this->zoom);
+}
+
+QPointF PaintCanvas::getPan() const
+{
+  return this->pan;
+}
+
+void PaintCanvas::setPan(const QPointF& newPan)
+{
+  // Tiles are only ever copied, never resampled
+  this->pan = QPointF{newPan.toPoint()};
+  // The retained layer was drawn for the old view
+  this->layerValid = false;
+  this->update();
+}
+
+void PaintCanvas::markInteracting()
+{
+  this->interacting = true;
+  this->idleTimer.start();
+}
+
+void PaintCanvas::zoomIn()
+{
+  this->setZoomLevel(
+    this->zoomLevel + TileCache::levelsPerOctave,
+    QRectF{this->rect()}.center());
+}
+
+void PaintCanvas::zoomOut()
+{
+  this->setZoomLevel(
+    this->zoomLevel - TileCache::levelsPerOctave,
+    QRectF{this->rect()}.center());
+}
+
+void PaintCanvas::resetView()
+{
+  this->zoomLevel = 0;
+  this->zoom = 1.0;
+  this->setPan(QPointF{});
+}
+
+QTransform PaintCanvas::viewTransform() const
+{
+  return QTransform{
+    this->zoom, 0.0, 0.0, this->zoom, this->pan.x(), this->pan.y()};
+}
+
+QPointF PaintCanvas::toScene(const QPointF& widgetPos) const
+{
+  return (widgetPos - this->pan) / this->zoom;
+}
+
+QRectF PaintCanvas::toScene(const QRectF& widgetRect) const
+{
+  return QRectF{
+    this->toScene(widgetRect.topLeft()), widgetRect.size() / this->zoom};
+}
+
+QRect PaintCanvas::toView(const QRectF& sceneRect) const
+{
+  const QRectF r{
+    sceneRect.topLeft() * this->zoom + this->pan,
+    sceneRect.size() * this->zoom};
+  return r.toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+qsizetype PaintCanvas::getShapeCount() const
+{
+  return this->shapes.size();
+}
+
+qsizetype PaintCanvas::getSceneMemory() const
+{
+  return this->shapes.memoryUsage();
+}
+
+qreal PaintCanvas::getBytesPerShape() const
+{
+  return this->shapes.bytesPerShape();
 }
 
 bool PaintCanvas::isMoved() const
@@ -977,30 +1922,145 @@ void PaintCanvas::setLastPos(const QPointF& newLastPos)
 
 QImage PaintCanvas::toImage() const
 {
-  QImage img{size(), QImage::Format_ARGB32_Premultiplied};
-  img.fill(Qt::white);
-  QPainter p{&img};
-  p.setRenderHint(QPainter::Antialiasing, true);
+  const TraceSpan span{"toImage", "io"};
+  return this->snapshot().render();
+}
+
+SceneSnapshot PaintCanvas::snapshot() const
+{
+  SceneSnapshot snapshot{};
+  snapshot.shapes = this->shapes;
+  snapshot.index = this->index;
+  snapshot.settings = this->sceneSettings();
+  snapshot.maxShapeWidth = this->maxShapeWidth;
 
+  // From the scene origin, at least the widget and grown to every shape
+  // right or below of it, the view may have been panned anywhere. Capped
+  // so a stray far away shape cannot ask for gigabytes
+  this->shapes.updateBounds();
+  QRectF extent{};
   std::ranges::for_each(
-    this->shapes,
-    [this, &p](const auto& s)
-    {
-      const QPainterPath path{shapePath(s)};
-      QPen pen{s.pen, static_cast<qreal>(s.width)};
-      pen.setCapStyle(Qt::RoundCap);
-      pen.setJoinStyle(Qt::RoundJoin);
-      p.setPen(pen);
-      if (this->getFill())
-      {
-        p.setBrush(s.fill);
-      }
-      else
-      {
-        p.setBrush(Qt::NoBrush);
-      }
-      p.drawPath(path);
+    std::views::iota(0, static_cast<int>(this->shapes.size())),
+    [this, &extent](const int i)
+    {
+      extent |= this->shapes.bounds(i);
+    });
+  const qreal margin{this->maxShapeWidth / 2.0 + 2.0};
+  snapshot.size = this->size().expandedTo(QSize{
+    qCeil(qMin<qreal>(maxSnapshotSide, extent.right() + margin)),
+    qCeil(qMin<qreal>(maxSnapshotSide, extent.bottom() + margin))});
+  return snapshot;
+}
+
+SceneSnapshot PaintCanvas::tileScene() const
+{
+  // Workers must not build the bounds of the shared store themselves
+  this->shapes.updateBounds();
+  SceneSnapshot scene{};
+  scene.shapes = this->shapes;
+  scene.index = this->index;
+  scene.settings = this->sceneSettings();
+  scene.maxShapeWidth = this->maxShapeWidth;
+  return scene;
+}
+
+bool PaintCanvas::isStatsVisible() const
+{
+  return this->statsVisible;
+}
+
+void PaintCanvas::setStatsVisible(const bool isStatsVisible)
+{
+  this->statsVisible = isStatsVisible;
+  if (isStatsVisible)
+  {
+    this->statsTimer.start();
+  }
+  else
+  {
+    this->statsTimer.stop();
+  }
+  this->update(this->statsRect());
+}
+
+const FrameStats& PaintCanvas::getStats() const
+{
+  return this->stats;
+}
+
+QRect PaintCanvas::statsRect() const
+{
+  return QRect{8, 8, 240, 200};
+}
+
+void PaintCanvas::drawStats(QPainter& p) const
+{
+  const QRect panel{this->statsRect()};
+  p.save();
+  p.setRenderHint(QPainter::Antialiasing, false);
+  p.setPen(Qt::darkGray);
+  p.setBrush(QColor{255, 255, 255, 220});
+  p.drawRect(panel.adjusted(0, 0, -1, -1));
+
+  const FrameStats::Frame last{
+    this->stats.isEmpty() ? FrameStats::Frame{} : this->stats.last()};
+  const qsizetype memory{
+    this->shapes.memoryUsage() + this->history.memoryUsage()};
+  QStringList lines{
+    QString{"Paint: %1 ms (avg %2 ms)"}
+      .arg(last.paintNs / 1.0e6, 0, 'f', 2)
+      .arg(this->stats.averagePaintMs(), 0, 'f', 2),
+    QString{"FPS: %1"}.arg(this->stats.fps()),
+    QString{"Drawn: %1, culled: %2"}.arg(last.drawn).arg(last.culled),
+    QString{"Selected: %1"}.arg(this->shapes.selectionSize()),
+    QString{"Last hit test: %1 ms"}.arg(
+      this->stats.getLastHitTestNs() / 1.0e6, 0, 'f', 3),
+    QString{"Last edit: %1 ms"}.arg(
+      this->stats.getLastEditNs() / 1.0e6, 0, 'f', 2),
+    QString{"Memory: %1 MiB"}.arg(memory / (1024.0 * 1024.0), 0, 'f', 1)};
+  if (AllocationCounter::enabled)
+  {
+    lines.push_back(QString{"Allocations: %1"}.arg(last.allocations));
+  }
+
+  p.setPen(Qt::black);
+  const int lineHeight{p.fontMetrics().height()};
+  int y{panel.top() + 4};
+  std::ranges::for_each(
+    lines,
+    [&p, &panel, &y, lineHeight](const QString& line)
+    {
+      p.drawText(
+        QRect{panel.left() + 6, y, panel.width() - 12, lineHeight},
+        Qt::AlignLeft | Qt::AlignVCenter,
+        line);
+      y += lineHeight;
     });
 
-  return img;
+  // Paint time histogram of the recent frames, one bar per bucket
+  const FrameStats::Histogram buckets{this->stats.histogram()};
+  const int most{qMax(1, *std::ranges::max_element(buckets))};
+  const int barWidth{(panel.width() - 12) / static_cast<int>(buckets.size())};
+  const int barsTop{y + 4};
+  const int barsHeight{panel.bottom() - barsTop - lineHeight - 4};
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(buckets.size())),
+    [&p, &buckets, &panel, most, barWidth, barsTop, barsHeight, lineHeight](
+      const int b)
+    {
+      const int height{barsHeight * buckets.at(b) / most};
+      const int x{panel.left() + 6 + b * barWidth};
+      p.fillRect(
+        QRect{x, barsTop + barsHeight - height, barWidth - 2, height},
+        b < 4 ? QColor{Qt::darkGreen} : QColor{Qt::darkRed});
+      const QString label{
+        b < static_cast<int>(FrameStats::bucketLimits.size())
+          ? QString{"<%1"}.arg(FrameStats::bucketLimits.at(b))
+          : QString{"more"}};
+      p.drawText(
+        QRect{x, barsTop + barsHeight + 2, barWidth, lineHeight},
+        Qt::AlignHCenter | Qt::AlignTop,
+        label);
+    });
+  p.restore();
 }
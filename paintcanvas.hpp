@@ -1,28 +1,44 @@
 #pragma once
 
+#include "framestats.hpp"
+#include "scenecodec.hpp"
+#include "sceneedit.hpp"
+#include "scenesnapshot.hpp"
+#include "shapestore.hpp"
+#include "spatialindex.hpp"
+#include "tilecache.hpp"
+#include "tilerenderer.hpp"
+#include "undostack.hpp"
+
 #include <QApplication>
 #include <QClipboard>
+#include <QElapsedTimer>
 #include <QFileInfo>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QMimeData>
 #include <QMouseEvent>
 #include <QPaintEvent>
 #include <QPainter>
 #include <QPainterPath>
+#include <QTimer>
+#include <QTransform>
 #include <QUrl>
+#include <QWheelEvent>
 #include <QWidget>
 #include <QtMath>
 
 // C++ standard
 #include <algorithm>
+#include <cmath>
 #include <memory>
+#include <numeric>
 #include <ranges>
 
 class PaintCanvas : public QWidget
 {
   Q_OBJECT
+  // Measures the private hot paths directly
+  friend class CanvasBench;
+
 public:
   enum class ToolType
   {
@@ -57,10 +73,39 @@ public:
   void setImage(const QImage& newImage);
 
   void clearAll();
+  // Replays an edit recorded earlier without reporting it again. Returns
+  // false, leaving the scene alone, if it does not fit the current scene.
+  // The caller repaints
+  bool applyEdit(const SceneEdit& edit);
+
+  // Undo and redo report the edits they make like any other edit. Loading
+  // a drawing forgets the history
+  void undo();
+  void redo();
+  bool canUndo() const;
+  bool canRedo() const;
+  // Memory the history may take before its oldest steps are dropped
+  qsizetype getUndoMemoryLimit() const;
+  void setUndoMemoryLimit(const qsizetype newUndoMemoryLimit);
+  qsizetype getUndoMemory() const;
 
   QImage toImage() const;
   QString toSerialized() const;
   void loadFromSerialized(const QString& json);
+  QByteArray toBinary() const;
+  bool loadFromBinary(const QByteArray& cbor);
+  // Scene in the text chunks of a saved PNG, the JSON chunk only when
+  // asked for. Reading prefers the binary chunk and falls back to JSON
+  void writeToImage(QImage& img, const bool withJson = false) const;
+  void loadFromImage(const QImage& img);
+  // Native scene file, opened by mapping it instead of reading it
+  bool saveSceneFile(const QString& path);
+  bool openSceneFile(const QString& path);
+  // Copies the shapes out of the scene file at path if they are mapped
+  // from it, so that the file can be replaced. Take snapshots for saving
+  // to that file after calling it
+  void releaseSceneFile(const QString& path);
+  SceneSnapshot snapshot() const;
   bool isMoved() const;
   void setMoved(const bool isMoved);
 
@@ -87,18 +132,48 @@ public:
   bool isClonesCreated() const;
   void setClonesCreated(const bool isClonesCreated);
 
-private:
-  struct Shape
-  {
-    ToolType type{ToolType::Rect};
-    QVector<QPointF> points{};
-    qreal rotation{0.0};
-    bool isSelected{false};
-    QColor pen{Qt::black};
-    QColor fill{Qt::gray};
-    int width{3};
-  };
+  // Extra pick distance beyond the outer edge of a stroke, in pixels of
+  // the widget whatever the zoom
+  qreal getHitTolerance() const;
+  void setHitTolerance(const qreal newHitTolerance);
 
+  // View of the scene, widget = scene * zoom + pan. The wheel zooms, a
+  // left drag with Space held pans. Input, hit testing and editing work in
+  // scene coordinates. The zoom moves in the levels of the tile cache and
+  // the pan in whole pixels, so unchanged parts of the view are copies of
+  // cached tiles
+  static constexpr qreal minZoom{1.0 / 256.0};
+  static constexpr qreal maxZoom{64.0};
+  static constexpr int minZoomLevel{-8 * TileCache::levelsPerOctave};
+  static constexpr int maxZoomLevel{6 * TileCache::levelsPerOctave};
+  qreal getZoom() const;
+  // Keeps the scene point under anchor, a widget position, where it is.
+  // Snaps to the nearest level
+  void setZoom(const qreal newZoom, const QPointF& anchor);
+  QPointF getPan() const;
+  // Rounded to whole pixels
+  void setPan(const QPointF& newPan);
+  // Zoom steps around the middle of the widget
+  void zoomIn();
+  void zoomOut();
+  void resetView();
+  QTransform viewTransform() const;
+  QPointF toScene(const QPointF& widgetPos) const;
+  QRectF toScene(const QRectF& widgetRect) const;
+  // Widget pixels showing a scene rectangle, with room for antialiasing
+  QRect toView(const QRectF& sceneRect) const;
+
+  qsizetype getShapeCount() const;
+  qsizetype getSceneMemory() const;
+  qreal getBytesPerShape() const;
+
+  // Panel in the corner with frame times, shape counts, the cost of the
+  // last hit test and edit and the memory in use
+  bool isStatsVisible() const;
+  void setStatsVisible(const bool isStatsVisible);
+  const FrameStats& getStats() const;
+
+private:
   ToolType tool{ToolType::Modify};
   bool fill{false};
   bool drawingEnabled{false};
@@ -108,9 +183,40 @@ private:
   QPointF lastPoint{};
   QPointF lastPos{};
   QRectF lastRect{};
+  // Retained raster of the unselected shapes while a selection is dragged,
+  // rotated or cloned; only valid between the first move and the release
   QImage image{};
+  bool layerValid{false};
 
-  QVector<Shape> shapes;
+  ShapeStore shapes{};
+  // Scene file the shape columns were mapped from
+  QString mappedPath{};
+  SpatialIndex index{};
+  UndoStack history{};
+  int maxShapeWidth{0};
+  qreal hitTolerance{2.0};
+  // Kept across frames, so painting an unchanged scene allocates nothing
+  mutable PaintStyles paintStyles{};
+  QVector<int> visibleScratch{};
+  int zoomLevel{0};
+  qreal zoom{1.0};
+  QPointF pan{};
+  // Wheel rotation not yet turned into a zoom level
+  int wheelDelta{0};
+  // Space held turns a left drag into panning
+  bool panKeyDown{false};
+  bool panning{false};
+  QPointF panFrom{};
+  TileCache tileCache{};
+  FrameStats stats{};
+  bool statsVisible{false};
+  // Refreshes the panel while it is shown, the scene may be idle
+  QTimer statsTimer{};
+  // Set by gestures, wheel turns and drags until input has been idle for
+  // the interval of idleTimer. Meanwhile shapes are drawn as cheap previews
+  // and no tiles are rendered, after it the tiles refine the view
+  bool interacting{false};
+  QTimer idleTimer{};
   QVector<Shape> clones;
   QVector<QPointF> trianglePoints;
   QRectF selectionRect{};
@@ -122,10 +228,44 @@ private:
   bool rotated{false};
   bool cloned{false};
   bool clonesCreated{false};
+  // Move and rotation of the selection collected during a gesture. Selected
+  // shapes are drawn and hit-tested through it and only written back into
+  // the store on release
+  bool transformPending{false};
+  QPointF pendingOffset{};
+  qreal pendingRotation{0.0};
+  QPointF pendingCenter{};
 
-  QPainterPath shapePath(const Shape& s) const;
-  QPointF shapeCenter(const Shape& s) const;
-  QRectF shapeBounds(const Shape& s) const;
+  const QPainterPath& shapePath(const int i) const;
+  QPointF shapeCenter(const int i) const;
+  QRectF shapeBounds(const int i) const;
+  QRect paintBounds(const int i) const;
+  QRect overlayBounds() const;
+  QRectF drawingPreviewRect() const;
+  static constexpr int maxSnapshotSide{16384};
+  // Draws the shapes under dirty, which the tiles did not cover, over a
+  // white background and counts them
+  void paintScene(QPainter& p, const QRegion& dirty, int& drawn);
+  void drawShape(QPainter& p, const int i) const;
+  qreal sceneHitTolerance() const;
+  void setZoomLevel(const int level, const QPointF& anchor);
+  void markInteracting();
+  // Drops the cached tiles under the fill bounds of a shape and its stroke
+  void invalidateTiles(const QRectF& bounds);
+  // The committed scene for the tile workers, every bounds entry built
+  SceneSnapshot tileScene() const;
+  void drawSelectionFrame(QPainter& p, const int i) const;
+  void renderStaticLayer();
+  ShapeStyle currentStyle() const;
+  int appendShape(const Shape& s);
+  int createShape(const Shape& s);
+  void commitEdit(const SceneEdit& edit);
+  // Edit reversing edit on the current scene, before edit is applied
+  SceneEdit inverseOf(const SceneEdit& edit) const;
+  void applyHistory(const QVector<SceneEdit>& edits);
+  void clearCanvas();
+  void reindexShape(const int i);
+  void rebuildIndex();
 
   bool isImage(const QString& fullpath) const;
   void resizeImage(QImage* const image, const QSize& newSize);
@@ -137,18 +277,33 @@ private:
   Shape makeEllipseShape(const QPointF& center, const QPointF& cursor) const;
   Shape makeTriangleShape(const QVector<QPointF>& pts) const;
 
-  bool hitTest(const Shape& s, const QPointF& p) const;
+  bool hitTest(const int i, const QPointF& p) const;
+  bool anySelected() const;
   void clearSelections();
-  void selectShape(Shape& s, const bool add);
+  void selectShape(const int i, const bool add);
   void applySelectionRect(const bool add);
-  void moveSelected(const QPointF& delta);
+  // Both take the whole gesture so far, not the step since the last event
+  void moveSelected(const QPointF& offset);
   void rotateSelected(const QPointF& start, const QPointF& now);
+  void beginPendingTransform();
+  void commitPendingTransform();
+  bool isPending(const int i) const;
+  QTransform pendingTransform(const int i) const;
   void cloneSelected();
   void deleteSelected();
-  Shape* topHit(const QPointF& p);
+  int topHit(const QPointF& p) const;
+  // topHit for input handling, its cost goes into the stats
+  int timedTopHit(const QPointF& p);
+  QRect statsRect() const;
+  void drawStats(QPainter& p) const;
+
+  SceneCodec::Settings sceneSettings() const;
+  void applySceneSettings(const SceneCodec::Settings& settings);
+  void resetScene();
 
-  QJsonObject shapeToJson(const Shape& s) const;
-  Shape jsonToShape(const QJsonObject& obj) const;
+signals:
+  // Every change to the scene, once it has been made
+  void edited(const SceneEdit& edit);
 
 protected:
   virtual void mousePressEvent(QMouseEvent* event) override;
@@ -157,4 +312,6 @@ protected:
   virtual void paintEvent(QPaintEvent* event) override;
   virtual void resizeEvent(QResizeEvent* event) override;
   virtual void keyPressEvent(QKeyEvent* event) override;
+  virtual void keyReleaseEvent(QKeyEvent* event) override;
+  virtual void wheelEvent(QWheelEvent* event) override;
 };
@@ -0,0 +1,141 @@
+#include "paintstyles.hpp"
+
+#include <QtMath>
+
+// C++ standard
+#include <algorithm>
+
+void PaintStyles::apply(
+  QPainter& p, const ShapeStore& shapes, const int i, const bool fill)
+{
+  const Entry& entry{this->entry(shapes, i)};
+  p.setPen(entry.pen);
+  if (fill)
+  {
+    p.setBrush(entry.brush);
+  }
+  else
+  {
+    p.setBrush(Qt::NoBrush);
+  }
+}
+
+void PaintStyles::clear()
+{
+  this->entries.clear();
+}
+
+void PaintStyles::setView(
+  const QSize& size,
+  const qreal zoom,
+  const QPointF& pan,
+  const qreal dpr,
+  const bool preview)
+{
+  std::ranges::for_each(
+    this->dotWords,
+    [this](const qsizetype word)
+    {
+      this->dots[word] = 0;
+    });
+  this->dotWords.clear();
+
+  this->viewSize = QSize{
+    qMax(0, qCeil(size.width() * dpr)), qMax(0, qCeil(size.height() * dpr))};
+  this->zoom = zoom;
+  this->pan = pan;
+  this->dpr = dpr;
+  this->preview = preview;
+  const qsizetype words{
+    (qsizetype{this->viewSize.width()} * this->viewSize.height() + 63) / 64};
+  if ((zoom < 1.0 || preview) && this->dots.size() < words)
+  {
+    this->dots.resize(words);
+  }
+}
+
+bool PaintStyles::drawReduced(
+  QPainter& p,
+  const ShapeStore& shapes,
+  const int i,
+  const bool fill,
+  const QRectF& bounds)
+{
+  if (this->zoom >= 1.0 && !this->preview)
+  {
+    return false;
+  }
+
+  const qreal pixels{qMax(bounds.width(), bounds.height()) * this->zoom};
+  const qreal boxPixels{this->preview ? previewBoxPixels : lodBoxPixels};
+  if (pixels < lodDotPixels)
+  {
+    if (this->claimDot(bounds.center()))
+    {
+      p.setPen(this->entry(shapes, i).dotPen);
+      p.drawPoint(bounds.center());
+    }
+    return true;
+  }
+  if (pixels < boxPixels)
+  {
+    const Entry& entry{this->entry(shapes, i)};
+    p.fillRect(bounds, fill ? entry.brush : entry.strokeBrush);
+    return true;
+  }
+  return false;
+}
+
+PaintStyles::Entry& PaintStyles::entry(const ShapeStore& shapes, const int i)
+{
+  const quint32 id{shapes.styleIndex(i)};
+  if (id >= static_cast<quint32>(this->entries.size()))
+  {
+    this->entries.resize(id + 1);
+  }
+
+  Entry& entry{this->entries[id]};
+  const ShapeStyle& style{shapes.style(i)};
+  if (!entry.valid || entry.style != style)
+  {
+    entry.style = style;
+    entry.pen = QPen{
+      style.pen,
+      static_cast<qreal>(style.width),
+      Qt::SolidLine,
+      Qt::RoundCap,
+      Qt::RoundJoin};
+    entry.brush = QBrush{style.fill};
+    // Zero width is the cosmetic one pixel pen
+    entry.dotPen = QPen{style.pen, 0.0};
+    entry.strokeBrush = QBrush{style.pen};
+    entry.valid = true;
+  }
+  return entry;
+}
+
+bool PaintStyles::claimDot(const QPointF& scenePos)
+{
+  const QPointF pos{(scenePos * this->zoom + this->pan) * this->dpr};
+  const int x{qFloor(pos.x())};
+  const int y{qFloor(pos.y())};
+  if (
+    x < 0 || y < 0 || x >= this->viewSize.width() ||
+    y >= this->viewSize.height())
+  {
+    return false;
+  }
+  const qsizetype bit{qsizetype{y} * this->viewSize.width() + x};
+  quint64& word{this->dots[bit / 64]};
+  const quint64 mask{quint64{1} << (bit % 64)};
+  if ((word & mask) != 0)
+  {
+    return false;
+  }
+  if (word == 0)
+  {
+    this->dotWords.push_back(bit / 64);
+  }
+  word |= mask;
+  return true;
+}
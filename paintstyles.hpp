@@ -0,0 +1,81 @@
+#pragma once
+
+#include "shapestore.hpp"
+
+#include <QBrush>
+#include <QPainter>
+#include <QPen>
+#include <QSize>
+#include <QVector>
+
+// Pens and brushes of a style table, built once per style so drawing a
+// shape only hands shared handles to the painter instead of allocating a
+// new pen and brush. Entries are keyed by the style index and checked
+// against the style itself, so one cache can serve any store. Not thread
+// safe, every painting thread keeps its own. Pool workers keep theirs in a
+// thread_local: a worker outlives the tile or image it renders, so its pens
+// and brushes are reused by the next one.
+//
+// Also draws the reduced forms of a zoomed out view: shapes smaller than
+// lodBoxPixels become a box of their bounds, below lodDotPixels a dot, and
+// a pixel holding a dot takes no further ones. Previews drawn during a
+// gesture reduce more, up to previewBoxPixels and at any zoom.
+class PaintStyles
+{
+public:
+  static constexpr qreal lodBoxPixels{4.0};
+  static constexpr qreal lodDotPixels{1.0};
+  static constexpr qreal previewBoxPixels{8.0};
+
+  // Sets pen and brush of shape i, no brush unless fill
+  void apply(
+    QPainter& p, const ShapeStore& shapes, const int i, const bool fill);
+  void clear();
+
+  // Starts a target of size logical pixels that shows the scene at zoom,
+  // moved by pan, with dpr device pixels to a logical one. Reduced forms
+  // are only used below a zoom of one or for a preview
+  void setView(
+    const QSize& size,
+    const qreal zoom,
+    const QPointF& pan,
+    const qreal dpr,
+    const bool preview);
+  // Draws shape i, whose scene bounds are given, reduced if the view
+  // leaves it only a few pixels. Returns false, drawing nothing, when it
+  // needs its full path
+  bool drawReduced(
+    QPainter& p,
+    const ShapeStore& shapes,
+    const int i,
+    const bool fill,
+    const QRectF& bounds);
+
+private:
+  struct Entry
+  {
+    ShapeStyle style{};
+    QPen pen{};
+    QBrush brush{};
+    // Cosmetic one pixel pen of the stroke color
+    QPen dotPen{};
+    QBrush strokeBrush{};
+    bool valid{false};
+  };
+
+  QVector<Entry> entries{};
+  // In device pixels, as the dots are drawn
+  QSize viewSize{};
+  qreal zoom{1.0};
+  QPointF pan{};
+  qreal dpr{1.0};
+  bool preview{false};
+  // One bit per device pixel of the target, kept across targets. Only the
+  // words a target set are cleared for the next one, most stay zero
+  QVector<quint64> dots{};
+  QVector<qsizetype> dotWords{};
+
+  Entry& entry(const ShapeStore& shapes, const int i);
+  // False if the target pixel under the scene point has a dot already
+  bool claimDot(const QPointF& scenePos);
+};
@@ -0,0 +1,378 @@
+#include "scenecodec.hpp"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QtEndian>
+
+// C++ standard
+#include <algorithm>
+#include <ranges>
+#include <utility>
+
+QString SceneCodec::toJson(const ShapeStore& store, const Settings& settings)
+{
+  // Only the styles some shape still uses, numbered by first use
+  QVector<int> storeToFile(store.styleTable().size(), -1);
+  QJsonArray styles{};
+  QJsonArray arr{};
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(store.size())),
+    [&store, &storeToFile, &styles, &arr](const int i)
+    {
+      int& style{storeToFile[store.styleIndex(i)]};
+      if (style < 0)
+      {
+        style = static_cast<int>(styles.size());
+        styles.append(styleToJson(store.style(i)));
+      }
+      arr.append(shapeToJson(store, i, style));
+    });
+
+  QJsonObject root{};
+  root["styles"] = styles;
+  root["shapes"] = arr;
+  root["fill"] = settings.fill;
+  root["penColor"] = settings.penColor.name(QColor::HexArgb);
+  root["fillColor"] = settings.fillColor.name(QColor::HexArgb);
+  root["penWidth"] = settings.penWidth;
+
+  return QString::fromUtf8(QJsonDocument{root}.toJson(QJsonDocument::Compact));
+}
+
+bool SceneCodec::fromJson(
+  const QString& json, ShapeStore& store, Settings& settings)
+{
+  const QJsonDocument doc{QJsonDocument::fromJson(json.toUtf8())};
+  if (!doc.isObject())
+  {
+    return false;
+  }
+
+  const QJsonObject root{doc.object()};
+  const QJsonArray arr{root["shapes"].toArray()};
+
+  QVector<ShapeStyle> styles{};
+  std::ranges::for_each(
+    root["styles"].toArray(),
+    [&styles](const auto& v)
+    {
+      styles.push_back(jsonToStyle(v.toObject()));
+    });
+
+  store.reserve(store.size() + arr.size());
+  std::ranges::for_each(
+    arr,
+    [&store, &styles](const auto& v)
+    {
+      if (!v.isObject())
+      {
+        return;
+      }
+      const std::optional<Shape> s{jsonToShape(v.toObject(), styles)};
+      if (s.has_value())
+      {
+        store.append(*s);
+      }
+    });
+
+  if (root.contains("fill"))
+  {
+    settings.fill = root["fill"].toBool(settings.fill);
+  }
+  if (root.contains("penColor"))
+  {
+    settings.penColor = QColor{root["penColor"].toString()};
+  }
+  if (root.contains("fillColor"))
+  {
+    settings.fillColor = QColor{root["fillColor"].toString()};
+  }
+  if (root.contains("penWidth"))
+  {
+    settings.penWidth = root["penWidth"].toInt(settings.penWidth);
+  }
+
+  return true;
+}
+
+QByteArray SceneCodec::toCbor(const ShapeStore& store, const Settings& settings)
+{
+  const qsizetype count{store.size()};
+
+  // The store may hold equal styles under several indices, the file keeps
+  // each distinct one once
+  QHash<std::pair<quint64, int>, quint32> fileStyles{};
+  QHash<quint32, quint32> storeToFile{};
+  QCborArray styles{};
+
+  QByteArray types(count, Qt::Uninitialized);
+  QByteArray styleIds(count * sizeof(quint32), Qt::Uninitialized);
+  QByteArray rotations(count * sizeof(double), Qt::Uninitialized);
+  QByteArray points{};
+  points.reserve(count * 2 * 2 * sizeof(double));
+
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    const int shape{static_cast<int>(i)};
+    const quint32 storeStyle{store.styleIndex(shape)};
+    auto mapped{storeToFile.constFind(storeStyle)};
+    if (mapped == storeToFile.cend())
+    {
+      const ShapeStyle& style{store.style(shape)};
+      const std::pair<quint64, int> key{
+        (static_cast<quint64>(style.pen.rgba()) << 32) | style.fill.rgba(),
+        style.width};
+      auto known{fileStyles.constFind(key)};
+      if (known == fileStyles.cend())
+      {
+        known = fileStyles.insert(key, static_cast<quint32>(styles.size()));
+        styles.append(QCborArray{
+          static_cast<qint64>(style.pen.rgba()),
+          static_cast<qint64>(style.fill.rgba()),
+          style.width});
+      }
+      mapped = storeToFile.insert(storeStyle, known.value());
+    }
+
+    types[i] = static_cast<char>(store.type(shape));
+    qToLittleEndian<quint32>(
+      mapped.value(), styleIds.data() + i * sizeof(quint32));
+    qToLittleEndian<double>(
+      store.rotation(shape), rotations.data() + i * sizeof(double));
+
+    std::ranges::for_each(
+      store.points(shape) | std::views::take(store.pointCount(shape)),
+      [&points](const QPointF& p)
+      {
+        char buffer[2 * sizeof(double)];
+        qToLittleEndian<double>(p.x(), buffer);
+        qToLittleEndian<double>(p.y(), buffer + sizeof(double));
+        points.append(buffer, sizeof(buffer));
+      });
+  }
+
+  QCborMap root{};
+  root[QLatin1String{"version"}] = version;
+  root[QLatin1String{"fill"}] = settings.fill;
+  root[QLatin1String{"penColor"}] =
+    static_cast<qint64>(settings.penColor.rgba());
+  root[QLatin1String{"fillColor"}] =
+    static_cast<qint64>(settings.fillColor.rgba());
+  root[QLatin1String{"penWidth"}] = settings.penWidth;
+  root[QLatin1String{"count"}] = static_cast<qint64>(count);
+  root[QLatin1String{"styles"}] = styles;
+  root[QLatin1String{"types"}] = types;
+  root[QLatin1String{"styleIds"}] = styleIds;
+  root[QLatin1String{"rotations"}] = rotations;
+  root[QLatin1String{"points"}] = points;
+
+  return root.toCborValue().toCbor();
+}
+
+bool SceneCodec::fromCbor(
+  const QByteArray& cbor, ShapeStore& store, Settings& settings)
+{
+  QCborParserError error{};
+  const QCborValue value{QCborValue::fromCbor(cbor, &error)};
+  if (error.error != QCborError::NoError || !value.isMap())
+  {
+    return false;
+  }
+
+  const QCborMap root{value.toMap()};
+  const qint64 fileVersion{root.value(QLatin1String{"version"}).toInteger()};
+  if (fileVersion != 1 && fileVersion != version)
+  {
+    return false;
+  }
+  // Version 1 stored floats
+  const qsizetype real{
+    fileVersion == 1 ? qsizetype{sizeof(float)} : qsizetype{sizeof(double)}};
+  const auto readReal = [real](const char* const p) -> qreal
+  {
+    return real == qsizetype{sizeof(float)} ? qFromLittleEndian<float>(p)
+                                            : qFromLittleEndian<double>(p);
+  };
+
+  const qint64 count{root.value(QLatin1String{"count"}).toInteger(-1)};
+  const QByteArray types{root.value(QLatin1String{"types"}).toByteArray()};
+  const QByteArray styleIds{
+    root.value(QLatin1String{"styleIds"}).toByteArray()};
+  const QByteArray rotations{
+    root.value(QLatin1String{"rotations"}).toByteArray()};
+  const QByteArray points{root.value(QLatin1String{"points"}).toByteArray()};
+  const QCborArray styleTable{root.value(QLatin1String{"styles"}).toArray()};
+
+  if (
+    count < 0 || types.size() != count ||
+    styleIds.size() != count * qsizetype{sizeof(quint32)} ||
+    rotations.size() != count * real)
+  {
+    return false;
+  }
+
+  QVector<ShapeStyle> styles{};
+  styles.reserve(styleTable.size());
+  std::ranges::for_each(
+    styleTable,
+    [&styles](const QCborValue& v)
+    {
+      const QCborArray entry{v.toArray()};
+      ShapeStyle style{};
+      style.pen = QColor::fromRgba(static_cast<QRgb>(entry.at(0).toInteger()));
+      style.fill = QColor::fromRgba(static_cast<QRgb>(entry.at(1).toInteger()));
+      style.width = static_cast<int>(entry.at(2).toInteger());
+      styles.push_back(style);
+    });
+
+  // Validate everything before touching the store
+  qsizetype pointBytes{0};
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    const int type{static_cast<quint8>(types.at(i))};
+    const quint32 style{qFromLittleEndian<quint32>(
+      styleIds.constData() + i * sizeof(quint32))};
+    if (!isValidType(type) || style >= static_cast<quint32>(styles.size()))
+    {
+      return false;
+    }
+    pointBytes +=
+      ShapeStore::pointCountOf(static_cast<ShapeType>(type)) * 2 * real;
+  }
+  if (points.size() != pointBytes)
+  {
+    return false;
+  }
+
+  store.reserve(store.size() + count);
+  const char* p{points.constData()};
+  for (qsizetype i{0}; i < count; ++i)
+  {
+    Shape s{};
+    s.type = static_cast<ShapeType>(static_cast<quint8>(types.at(i)));
+    s.rotation = readReal(rotations.constData() + i * real);
+    s.style = styles.at(qFromLittleEndian<quint32>(
+      styleIds.constData() + i * sizeof(quint32)));
+    std::ranges::for_each(
+      s.points | std::views::take(ShapeStore::pointCountOf(s.type)),
+      [&p, real, &readReal](QPointF& pt)
+      {
+        pt = QPointF{readReal(p), readReal(p + real)};
+        p += 2 * real;
+      });
+    store.append(s);
+  }
+
+  settings.fill = root.value(QLatin1String{"fill"}).toBool(settings.fill);
+  settings.penColor = QColor::fromRgba(static_cast<QRgb>(
+    root.value(QLatin1String{"penColor"})
+      .toInteger(settings.penColor.rgba())));
+  settings.fillColor = QColor::fromRgba(static_cast<QRgb>(
+    root.value(QLatin1String{"fillColor"})
+      .toInteger(settings.fillColor.rgba())));
+  settings.penWidth = static_cast<int>(
+    root.value(QLatin1String{"penWidth"}).toInteger(settings.penWidth));
+
+  return true;
+}
+
+QJsonObject SceneCodec::styleToJson(const ShapeStyle& style)
+{
+  QJsonObject obj{};
+  obj["width"] = style.width;
+  obj["pen"] = style.pen.name(QColor::HexArgb);
+  obj["fill"] = style.fill.name(QColor::HexArgb);
+  return obj;
+}
+
+ShapeStyle SceneCodec::jsonToStyle(const QJsonObject& obj)
+{
+  ShapeStyle style{};
+  style.width = obj["width"].toInt();
+  style.pen = QColor{obj["pen"].toString()};
+  style.fill = QColor{obj["fill"].toString()};
+  return style;
+}
+
+QJsonObject SceneCodec::shapeToJson(
+  const ShapeStore& store, const int i, const int style)
+{
+  QJsonObject obj{};
+  obj["type"] = static_cast<int>(store.type(i));
+  obj["rotation"] = store.rotation(i);
+  obj["style"] = style;
+
+  QJsonArray pts{};
+
+  std::ranges::for_each(
+    store.points(i) | std::views::take(store.pointCount(i)),
+    [&pts](const auto& p)
+    {
+      QJsonArray pt;
+      pt.append(p.x());
+      pt.append(p.y());
+      pts.append(pt);
+    });
+
+  obj["points"] = pts;
+  return obj;
+}
+
+std::optional<Shape> SceneCodec::jsonToShape(
+  const QJsonObject& obj, const QVector<ShapeStyle>& styles)
+{
+  const int type{obj["type"].toInt()};
+  if (!isValidType(type))
+  {
+    return std::nullopt;
+  }
+
+  Shape s{};
+  s.type = static_cast<ShapeType>(type);
+  s.rotation = obj["rotation"].toDouble();
+  if (obj.contains("style"))
+  {
+    const int style{obj["style"].toInt(-1)};
+    if (style < 0 || style >= styles.size())
+    {
+      return std::nullopt;
+    }
+    s.style = styles.at(style);
+  }
+  else
+  {
+    s.style = jsonToStyle(obj);
+  }
+
+  const QJsonArray pts{obj["points"].toArray()};
+  int count{0};
+
+  std::ranges::for_each(
+    pts,
+    [&s, &count](const auto& v)
+    {
+      const auto arr{v.toArray()};
+      if (arr.size() == 2 && count < Shape::maxPoints)
+      {
+        s.points[count++] =
+          QPointF{arr.at(0).toDouble(), arr.at(1).toDouble()};
+      }
+    });
+
+  if (count < ShapeStore::pointCountOf(s.type))
+  {
+    return std::nullopt;
+  }
+
+  return s;
+}
+
+bool SceneCodec::isValidType(const int type)
+{
+  return type >= static_cast<int>(ShapeType::Square) &&
+         type <= static_cast<int>(ShapeType::Ellipse);
+}
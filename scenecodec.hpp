@@ -0,0 +1,61 @@
+#pragma once
+
+#include "shapestore.hpp"
+
+#include <QByteArray>
+#include <QColor>
+#include <QJsonObject>
+#include <QString>
+
+// C++ standard
+#include <optional>
+
+// Reads and writes a whole scene. Two encodings exist:
+//  - JSON, the original "shapes" text chunk: a table of the styles in use
+//    with hex colors, then one object per shape with its style index and
+//    nested point arrays. Old files carrying the colors on every shape are
+//    still read.
+//  - CBOR, versioned: a deduplicated style table and packed little endian
+//    columns (types, style indices, double rotations, double points with
+//    only as many points as the type uses). Written by default. Version 1
+//    stored floats, which lose sub-pixel precision far from the origin of
+//    an unbounded scene; it is still read.
+class SceneCodec
+{
+public:
+  // Canvas settings stored next to the shapes
+  struct Settings
+  {
+    bool fill{false};
+    QColor penColor{Qt::black};
+    QColor fillColor{Qt::gray};
+    int penWidth{3};
+  };
+
+  // PNG text chunk keys; the binary scene is base64 encoded in its chunk.
+  // The JSON one is only written for older readers on request, readers
+  // prefer the binary one
+  static constexpr const char* binaryKey{"scene"};
+  static constexpr const char* jsonKey{"shapes"};
+  static constexpr int version{2};
+
+  static QString toJson(const ShapeStore& store, const Settings& settings);
+  // Appends to store. Settings missing from the document keep their value
+  static bool
+  fromJson(const QString& json, ShapeStore& store, Settings& settings);
+
+  static QByteArray toCbor(const ShapeStore& store, const Settings& settings);
+  // Appends to store, rejects unknown versions and truncated columns
+  static bool
+  fromCbor(const QByteArray& cbor, ShapeStore& store, Settings& settings);
+
+private:
+  static QJsonObject styleToJson(const ShapeStyle& style);
+  static ShapeStyle jsonToStyle(const QJsonObject& obj);
+  static QJsonObject shapeToJson(
+    const ShapeStore& store, const int i, const int style);
+  // Takes the style from styles when the shape names one
+  static std::optional<Shape>
+  jsonToShape(const QJsonObject& obj, const QVector<ShapeStyle>& styles);
+  static bool isValidType(const int type);
+};
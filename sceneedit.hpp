@@ -0,0 +1,40 @@
+#pragma once
+
+#include "scenecodec.hpp"
+#include "shapestore.hpp"
+
+#include <QPointF>
+#include <QVector>
+
+// One committed change to the scene. Every edit the canvas makes goes
+// through one of these, so replaying the same edits on the same scene
+// reproduces it exactly. Positions refer to the scene right before the edit.
+struct SceneEdit
+{
+  // Numbering is what the journal stores
+  enum class Kind : quint8
+  {
+    Clear = 1,
+    Create = 2,
+    Transform = 3,
+    Clone = 4,
+    Delete = 5,
+    Settings = 6,
+    Insert = 7,
+  };
+
+  Kind kind{Kind::Create};
+  // Transform, Clone and Delete: affected positions, ascending. Clones are
+  // appended in this order. Insert: positions the shapes end up at,
+  // ascending
+  QVector<int> indices{};
+  // Create: the appended shape
+  Shape shape{};
+  // Insert: one shape per position
+  QVector<Shape> shapes{};
+  // Transform: every shape turns about its own center, then moves
+  QPointF offset{};
+  qreal rotation{0.0};
+  // Settings: the canvas settings after the change
+  SceneCodec::Settings settings{};
+};
@@ -0,0 +1,278 @@
+#include "scenefile.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+// C++ standard
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+
+namespace
+{
+constexpr char magic[8]{'Q', 'S', 'H', 'P', 'S', 'C', 'N', '\0'};
+constexpr quint32 byteOrderMark{0x01020304};
+// Cache line, also more than any column element needs
+constexpr qint64 alignment{64};
+
+enum Section
+{
+  Styles,
+  Types,
+  StyleIds,
+  Rotations,
+  Points,
+  Bounds,
+  SectionCount,
+};
+
+struct Header
+{
+  char magic[8];
+  quint32 version;
+  quint32 byteOrder;
+  quint32 realSize;
+  quint32 fill;
+  qint64 count;
+  qint64 styleCount;
+  quint32 penColor;
+  quint32 fillColor;
+  qint32 penWidth;
+  quint32 reserved;
+  qint64 offsets[SectionCount];
+};
+
+struct StyleRecord
+{
+  quint32 pen;
+  quint32 fill;
+  qint32 width;
+  quint32 reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<ShapeStore::Points>);
+static_assert(std::is_trivially_copyable_v<QRectF>);
+static_assert(sizeof(ShapeStore::Points) == 6 * sizeof(qreal));
+static_assert(sizeof(QRectF) == 4 * sizeof(qreal));
+
+qint64 alignUp(const qint64 offset)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+std::array<qint64, SectionCount>
+sectionSizes(const qint64 count, const qint64 styleCount)
+{
+  return {
+    styleCount * qint64{sizeof(StyleRecord)},
+    count * qint64{sizeof(ShapeType)},
+    count * qint64{sizeof(quint32)},
+    count * qint64{sizeof(qreal)},
+    count * qint64{sizeof(ShapeStore::Points)},
+    count * qint64{sizeof(QRectF)}};
+}
+
+bool writeSection(
+  QSaveFile& file, const qint64 offset, const void* data, const qint64 bytes)
+{
+  const qint64 padding{offset - file.pos()};
+  if (padding > 0 && file.write(QByteArray(padding, '\0')) != padding)
+  {
+    return false;
+  }
+  return bytes == 0 ||
+         file.write(static_cast<const char*>(data), bytes) == bytes;
+}
+} // namespace
+
+bool SceneFile::isSceneFile(const QString& path)
+{
+  return QFileInfo{path}.suffix().compare(
+           QLatin1String{suffix}, Qt::CaseInsensitive) == 0;
+}
+
+bool SceneFile::save(
+  const QString& path,
+  const ShapeStore& store,
+  const SceneCodec::Settings& settings)
+{
+  const ShapeStore::ColumnViews views{store.columns()};
+  const QVector<ShapeStyle>& styles{store.styleTable()};
+
+  QVector<StyleRecord> records{};
+  records.reserve(styles.size());
+  std::ranges::for_each(
+    styles,
+    [&records](const ShapeStyle& style)
+    {
+      records.push_back(
+        StyleRecord{style.pen.rgba(), style.fill.rgba(), style.width, 0});
+    });
+
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.byteOrder = byteOrderMark;
+  header.realSize = sizeof(qreal);
+  header.fill = settings.fill ? 1 : 0;
+  header.count = views.count;
+  header.styleCount = records.size();
+  header.penColor = settings.penColor.rgba();
+  header.fillColor = settings.fillColor.rgba();
+  header.penWidth = settings.penWidth;
+
+  const std::array<qint64, SectionCount> sizes{
+    sectionSizes(header.count, header.styleCount)};
+  qint64 offset{qint64{sizeof(Header)}};
+  for (int s{0}; s < SectionCount; ++s)
+  {
+    header.offsets[s] = alignUp(offset);
+    offset = header.offsets[s] + sizes[s];
+  }
+
+  const std::array<const void*, SectionCount> data{
+    records.constData(),
+    views.types,
+    views.styleIds,
+    views.rotations,
+    views.points,
+    views.bounds};
+
+  QSaveFile file{path};
+  if (!file.open(QIODevice::WriteOnly))
+  {
+    return false;
+  }
+  if (
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header)) !=
+    qint64{sizeof(Header)})
+  {
+    file.cancelWriting();
+    return false;
+  }
+  for (int s{0}; s < SectionCount; ++s)
+  {
+    if (!writeSection(file, header.offsets[s], data[s], sizes[s]))
+    {
+      file.cancelWriting();
+      return false;
+    }
+  }
+  return file.commit();
+}
+
+bool SceneFile::open(
+  const QString& path, ShapeStore& store, SceneCodec::Settings& settings)
+{
+  // The store holds on to the file, the mapping lives as long as it does
+  const std::shared_ptr<QFile> file{std::make_shared<QFile>(path)};
+  if (!file->open(QIODevice::ReadOnly))
+  {
+    return false;
+  }
+
+  const qint64 fileSize{file->size()};
+  if (fileSize < qint64{sizeof(Header)})
+  {
+    return false;
+  }
+  const uchar* const base{file->map(0, fileSize)};
+  if (base == nullptr)
+  {
+    return false;
+  }
+
+  Header header{};
+  std::memcpy(&header, base, sizeof(Header));
+  if (
+    std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+    header.version != version || header.byteOrder != byteOrderMark ||
+    header.realSize != sizeof(qreal) || header.count < 0 ||
+    header.count > std::numeric_limits<int>::max() ||
+    header.count > fileSize || header.styleCount < 0 ||
+    header.styleCount > fileSize)
+  {
+    return false;
+  }
+
+  const std::array<qint64, SectionCount> sizes{
+    sectionSizes(header.count, header.styleCount)};
+  for (int s{0}; s < SectionCount; ++s)
+  {
+    const qint64 offset{header.offsets[s]};
+    if (
+      offset < qint64{sizeof(Header)} || offset % alignment != 0 ||
+      offset > fileSize || sizes[s] > fileSize - offset)
+    {
+      return false;
+    }
+  }
+
+  const auto section = [base, &header](const Section s)
+  {
+    return base + header.offsets[s];
+  };
+
+  const ShapeStore::ColumnViews views{
+    reinterpret_cast<const ShapeType*>(section(Types)),
+    reinterpret_cast<const ShapeStore::Points*>(section(Points)),
+    reinterpret_cast<const qreal*>(section(Rotations)),
+    reinterpret_cast<const quint32*>(section(StyleIds)),
+    reinterpret_cast<const QRectF*>(section(Bounds)),
+    header.count};
+
+  // The only full passes over the shapes: a bad type or style index would
+  // be read out of bounds later. Both columns are small next to the points
+  const quint8* const types{section(Types)};
+  const bool validTypes{std::ranges::all_of(
+    types,
+    types + header.count,
+    [](const quint8 type)
+    {
+      return type >= static_cast<quint8>(ShapeType::Square) &&
+             type <= static_cast<quint8>(ShapeType::Ellipse);
+    })};
+  const quint64 styleCount{static_cast<quint64>(header.styleCount)};
+  const bool validStyles{std::ranges::all_of(
+    views.styleIds,
+    views.styleIds + header.count,
+    [styleCount](const quint32 id)
+    {
+      return id < styleCount;
+    })};
+  if (!validTypes || !validStyles)
+  {
+    return false;
+  }
+
+  const StyleRecord* const records{
+    reinterpret_cast<const StyleRecord*>(section(Styles))};
+  QVector<ShapeStyle> styles{};
+  styles.reserve(header.styleCount);
+  std::ranges::for_each(
+    records,
+    records + header.styleCount,
+    [&styles](const StyleRecord& record)
+    {
+      ShapeStyle style{};
+      style.pen = QColor::fromRgba(record.pen);
+      style.fill = QColor::fromRgba(record.fill);
+      style.width = record.width;
+      styles.push_back(style);
+    });
+
+  store.adopt(views, styles, file);
+
+  settings.fill = header.fill != 0;
+  settings.penColor = QColor::fromRgba(header.penColor);
+  settings.fillColor = QColor::fromRgba(header.fillColor);
+  settings.penWidth = header.penWidth;
+
+  return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "scenecodec.hpp"
+#include "shapestore.hpp"
+
+#include <QString>
+
+// Native flat scene file, opened by mapping it into memory. The layout is
+// the in-memory one of ShapeStore, so the store views the shape columns in
+// place and pages are only read when a shape is touched:
+//  - a fixed header: magic, version, byte order marker, counts, canvas
+//    settings and the offset of every section
+//  - the style table, 16 bytes per style
+//  - the types, style indices, rotations, points (three per shape) and
+//    rotated bounds columns, each starting on a 64 byte boundary
+// Files are only read on machines with the byte order and qreal size they
+// were written with, anything else is rejected.
+class SceneFile
+{
+public:
+  static constexpr const char* suffix{"qshapes"};
+  static constexpr int version{1};
+
+  // Whether path names a scene file rather than an image, by its suffix
+  static bool isSceneFile(const QString& path);
+
+  static bool save(
+    const QString& path,
+    const ShapeStore& store,
+    const SceneCodec::Settings& settings);
+  // Replaces the contents of store, which keeps the file mapped until its
+  // columns are written to or it is detached
+  static bool
+  open(const QString& path, ShapeStore& store, SceneCodec::Settings& settings);
+};
@@ -0,0 +1,100 @@
+#include "scenesaver.hpp"
+#include "scenefile.hpp"
+#include "traceevents.hpp"
+
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+SceneSaver::SceneSaver(QObject* const parent) : QObject{parent}
+{
+  // Saves are serialized anyway, the tile renderer brings its own threads
+  this->pool.setMaxThreadCount(1);
+
+  this->connect(
+    &this->watcher,
+    &QFutureWatcher<bool>::progressValueChanged,
+    this,
+    [this](const int percent)
+    {
+      emit this->progressChanged(this->path, percent);
+    });
+  this->connect(
+    &this->watcher,
+    &QFutureWatcher<bool>::finished,
+    this,
+    [this]()
+    {
+      const QFuture<bool> future{this->watcher.future()};
+      emit this->finished(
+        this->path, future.resultCount() > 0 && future.result());
+    });
+}
+
+SceneSaver::~SceneSaver()
+{
+  this->watcher.waitForFinished();
+}
+
+bool SceneSaver::isBusy() const
+{
+  return this->watcher.isRunning();
+}
+
+QString SceneSaver::getPath() const
+{
+  return this->path;
+}
+
+bool SceneSaver::save(
+  const QString& path, const SceneSnapshot& snapshot, const bool withJson)
+{
+  if (this->isBusy())
+  {
+    return false;
+  }
+
+  this->path = path;
+  this->watcher.setFuture(QtConcurrent::run(
+    &this->pool,
+    [path, snapshot, withJson](QPromise<bool>& promise)
+    {
+      write(promise, path, snapshot, withJson);
+    }));
+  return true;
+}
+
+void SceneSaver::write(
+  QPromise<bool>& promise,
+  const QString& path,
+  const SceneSnapshot& snapshot,
+  const bool withJson)
+{
+  const TraceSpan span{"save", "worker"};
+  promise.setProgressRange(0, 100);
+
+  if (SceneFile::isSceneFile(path))
+  {
+    promise.addResult(
+      SceneFile::save(path, snapshot.shapes, snapshot.settings));
+    promise.setProgressValue(100);
+    return;
+  }
+
+  QImage img{snapshot.render()};
+  promise.setProgressValue(60);
+  snapshot.writeToImage(img, withJson);
+  promise.setProgressValue(70);
+
+  // An uncommitted QSaveFile removes its temporary file
+  QSaveFile file{path};
+  QImageWriter writer{&file, "PNG"};
+  bool ok{file.open(QIODevice::WriteOnly)};
+  {
+    const TraceSpan encode{"encode PNG", "io"};
+    ok = ok && writer.write(img);
+  }
+  ok = ok && file.commit();
+  promise.setProgressValue(100);
+  promise.addResult(ok);
+}
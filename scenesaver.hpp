@@ -0,0 +1,47 @@
+#pragma once
+
+#include "scenesnapshot.hpp"
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QPromise>
+#include <QString>
+#include <QThreadPool>
+
+// Writes scene snapshots on a thread of its own, one save at a time. PNG
+// targets get the rendered picture with the scene in its text chunks, scene
+// files only the shapes. Everything goes to a temporary file next to the
+// target, which replaces the target only once it is complete, so a failed
+// or interrupted save never leaves a truncated drawing behind.
+class SceneSaver : public QObject
+{
+  Q_OBJECT
+public:
+  explicit SceneSaver(QObject* const parent = nullptr);
+  // Waits for a running save
+  ~SceneSaver() override;
+
+  bool isBusy() const;
+  QString getPath() const;
+  // Does nothing and returns false while another save is running. PNGs
+  // get the JSON chunk as well with withJson
+  bool save(
+    const QString& path,
+    const SceneSnapshot& snapshot,
+    const bool withJson = false);
+
+signals:
+  void progressChanged(const QString& path, const int percent);
+  void finished(const QString& path, const bool ok);
+
+private:
+  QThreadPool pool{};
+  QFutureWatcher<bool> watcher{};
+  QString path{};
+
+  static void write(
+    QPromise<bool>& promise,
+    const QString& path,
+    const SceneSnapshot& snapshot,
+    const bool withJson);
+};
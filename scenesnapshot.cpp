@@ -0,0 +1,156 @@
+#include "scenesnapshot.hpp"
+#include "scenefile.hpp"
+#include "tilerenderer.hpp"
+#include "traceevents.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QPen>
+#include <QtMath>
+
+// C++ standard
+#include <algorithm>
+#include <limits>
+#include <ranges>
+
+QImage SceneSnapshot::render(const qreal scale) const
+{
+  const TraceSpan span{"render", "paint"};
+  const qreal margin{this->maxShapeWidth / 2.0 + 2.0};
+  const QSize target{
+    qMax(1, qCeil(this->size.width() * scale)),
+    qMax(1, qCeil(this->size.height() * scale))};
+
+  return TileRenderer{}.render(
+    target,
+    Qt::white,
+    [this, margin, scale](QPainter& p, const QRect& tile)
+    {
+      p.setRenderHint(QPainter::Antialiasing, true);
+      p.scale(scale, scale);
+
+      // Tile in scene coordinates
+      const QRectF area{
+        tile.x() / scale,
+        tile.y() / scale,
+        tile.width() / scale,
+        tile.height() / scale};
+      QVector<int> visible{this->index.query(
+        area.adjusted(-margin, -margin, margin, margin))};
+      std::ranges::sort(visible);
+
+      thread_local PaintStyles styles{};
+      std::ranges::for_each(
+        visible,
+        [this, &p](const int i)
+        {
+          drawShapeOnWorker(
+            p, this->shapes, i, this->settings.fill, styles);
+        });
+    });
+}
+
+void SceneSnapshot::writeToImage(QImage& img, const bool withJson) const
+{
+  img.setText(
+    SceneCodec::binaryKey,
+    QString::fromLatin1(
+      SceneCodec::toCbor(this->shapes, this->settings).toBase64()));
+  if (withJson)
+  {
+    img.setText(
+      SceneCodec::jsonKey, SceneCodec::toJson(this->shapes, this->settings));
+  }
+}
+
+bool SceneSnapshot::load(const QString& path)
+{
+  *this = SceneSnapshot{};
+
+  bool loaded{false};
+  if (SceneFile::isSceneFile(path))
+  {
+    loaded = SceneFile::open(path, this->shapes, this->settings);
+  }
+  else if (
+    QFileInfo{path}.suffix().compare("json", Qt::CaseInsensitive) == 0)
+  {
+    QFile file{path};
+    loaded = file.open(QIODevice::ReadOnly) &&
+             SceneCodec::fromJson(
+               QString::fromUtf8(file.readAll()), this->shapes, this->settings);
+  }
+  else
+  {
+    // Same order as the canvas: the binary chunk, then the older JSON one
+    const QImage img{path};
+    if (img.isNull())
+    {
+      return false;
+    }
+    this->size = img.size();
+    const QString binary{img.text(SceneCodec::binaryKey)};
+    loaded = !binary.isEmpty() &&
+             SceneCodec::fromCbor(
+               QByteArray::fromBase64(binary.toLatin1()),
+               this->shapes,
+               this->settings);
+    if (!loaded)
+    {
+      this->shapes.clear();
+      loaded = SceneCodec::fromJson(
+        img.text(SceneCodec::jsonKey), this->shapes, this->settings);
+    }
+  }
+  if (!loaded)
+  {
+    return false;
+  }
+
+  this->shapes.updateBounds();
+  QRectF extent{};
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(this->shapes.size())),
+    [this, &extent](const int i)
+    {
+      const QRectF bounds{this->shapes.bounds(i)};
+      this->index.insert(i, bounds);
+      this->maxShapeWidth =
+        qMax(this->maxShapeWidth, this->shapes.style(i).width);
+      extent |= bounds;
+    });
+
+  if (this->size.isEmpty())
+  {
+    // From the origin like the canvas, with room for the strokes. Far away
+    // shapes are clamped before rounding, the image then fails to allocate
+    const qreal margin{this->maxShapeWidth / 2.0 + 2.0};
+    constexpr qreal limit{std::numeric_limits<int>::max()};
+    this->size = QSize{
+      qMax(1, qCeil(qMin(limit, extent.right() + margin))),
+      qMax(1, qCeil(qMin(limit, extent.bottom() + margin)))};
+  }
+  return true;
+}
+
+void SceneSnapshot::drawShape(
+  QPainter& p,
+  const ShapeStore& shapes,
+  const int i,
+  const bool fill,
+  PaintStyles& styles)
+{
+  styles.apply(p, shapes, i, fill);
+  p.drawPath(shapes.path(i));
+}
+
+void SceneSnapshot::drawShapeOnWorker(
+  QPainter& p,
+  const ShapeStore& shapes,
+  const int i,
+  const bool fill,
+  PaintStyles& styles)
+{
+  styles.apply(p, shapes, i, fill);
+  p.drawPath(shapes.buildPath(i));
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "paintstyles.hpp"
+#include "scenecodec.hpp"
+#include "shapestore.hpp"
+#include "spatialindex.hpp"
+
+#include <QImage>
+#include <QPainter>
+#include <QSize>
+
+// Everything needed to rasterize and encode the scene away from the canvas.
+// Taking one is cheap: the store and the index share their data with the
+// canvas until either side writes, so a snapshot can be handed to a worker
+// thread while editing goes on. It holds the committed scene, a selection
+// that is being dragged is saved where it was picked up.
+struct SceneSnapshot
+{
+  ShapeStore shapes{};
+  SpatialIndex index{};
+  SceneCodec::Settings settings{};
+  QSize size{};
+  int maxShapeWidth{0};
+
+  // Draws the scene on a white background with the tile renderer, the
+  // image is size times scale. The cached paths are not touched, so the
+  // snapshot may share them with a canvas painting meanwhile
+  QImage render(const qreal scale = 1.0) const;
+  // Stores the scene in the binary text chunk of a PNG. withJson adds the
+  // JSON chunk for versions that predate the binary one, several times
+  // larger and slower to write
+  void writeToImage(QImage& img, const bool withJson = false) const;
+  // Replaces the snapshot with the drawing at path: a PNG carrying the
+  // scene chunks, a scene file or a JSON scene. Images keep their size,
+  // other scenes get the size of their shapes. Decodes like the canvas
+  // does and touches no widget, so any thread may load its own snapshot
+  bool load(const QString& path);
+
+  // Draws shape i with its cached path, on the thread owning the store
+  static void drawShape(
+    QPainter& p,
+    const ShapeStore& shapes,
+    const int i,
+    const bool fill,
+    PaintStyles& styles);
+  // Same pixels from a path built for this call alone. Drawing a path
+  // prepares data inside it without a lock, so threads that share paths
+  // with others must not draw them
+  static void drawShapeOnWorker(
+    QPainter& p,
+    const ShapeStore& shapes,
+    const int i,
+    const bool fill,
+    PaintStyles& styles);
+};
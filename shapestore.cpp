@@ -0,0 +1,800 @@
+#include "shapestore.hpp"
+#include "geometrykernels.hpp"
+
+#include <QTransform>
+
+// C++ standard
+#include <algorithm>
+#include <cmath>
+#include <ranges>
+#include <utility>
+
+qsizetype ShapeStore::size() const
+{
+  return this->types.size();
+}
+
+bool ShapeStore::isEmpty() const
+{
+  return this->types.isEmpty();
+}
+
+void ShapeStore::clear()
+{
+  this->types.clear();
+  this->pointArrays.clear();
+  this->rotations.clear();
+  this->styleIds.clear();
+  this->selectionBits.clear();
+  this->selected.clear();
+  this->styles.clear();
+  this->styleLookup.clear();
+  this->paths.clear();
+  this->pathValid.clear();
+  this->boundsCache.clear();
+  this->boundsValid.clear();
+  this->backing.reset();
+}
+
+void ShapeStore::reserve(const qsizetype n)
+{
+  this->types.reserve(n);
+  this->pointArrays.reserve(n);
+  this->rotations.reserve(n);
+  this->styleIds.reserve(n);
+  this->selectionBits.reserve((n + 63) / 64);
+  this->paths.reserve(n);
+  this->pathValid.reserve(n);
+  this->boundsCache.reserve(n);
+  this->boundsValid.reserve(n);
+}
+
+int ShapeStore::append(const Shape& s)
+{
+  const int i{static_cast<int>(this->types.size())};
+
+  this->types.push_back(s.type);
+  this->pointArrays.push_back(s.points);
+  this->rotations.push_back(s.rotation);
+  this->styleIds.push_back(this->addStyle(s.style));
+  if (i % 64 == 0)
+  {
+    this->selectionBits.push_back(0);
+  }
+
+  this->paths.push_back(QPainterPath{});
+  this->pathValid.push_back(false);
+  this->boundsCache.push_back(QRectF{});
+  this->boundsValid.push_back(false);
+
+  return i;
+}
+
+Shape ShapeStore::shape(const int i) const
+{
+  Shape s{};
+  s.type = this->type(i);
+  s.points = this->points(i);
+  s.rotation = this->rotation(i);
+  s.style = this->style(i);
+  return s;
+}
+
+void ShapeStore::remove(const QVector<int>& indices)
+{
+  if (indices.isEmpty())
+  {
+    return;
+  }
+
+  // One linear pass per column, every kept entry moves down at most once
+  const auto compact = [&indices](auto& column)
+  {
+    qsizetype out{indices.first()};
+    qsizetype next{0};
+    for (qsizetype in{indices.first()}; in < column.size(); ++in)
+    {
+      if (next < indices.size() && indices.at(next) == in)
+      {
+        ++next;
+        continue;
+      }
+      column[out++] = std::move(column[in]);
+    }
+    column.resize(out);
+  };
+
+  QVector<bool> selectedFlags(this->types.size());
+  std::ranges::for_each(
+    this->selected,
+    [&selectedFlags](const int i)
+    {
+      selectedFlags[i] = true;
+    });
+
+  compact(this->types);
+  compact(this->pointArrays);
+  compact(this->rotations);
+  compact(this->styleIds);
+  compact(this->paths);
+  compact(this->pathValid);
+  compact(this->boundsCache);
+  compact(this->boundsValid);
+  compact(selectedFlags);
+
+  this->selectionBits.fill(0, (selectedFlags.size() + 63) / 64);
+  this->selected.clear();
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(selectedFlags.size())),
+    [this, &selectedFlags](const int i)
+    {
+      this->setSelected(i, selectedFlags.at(i));
+    });
+}
+
+void ShapeStore::insert(
+  const QVector<int>& indices, const QVector<Shape>& shapes)
+{
+  if (indices.isEmpty())
+  {
+    return;
+  }
+
+  // One pass from the back per column, every entry behind the first new
+  // position moves up at most once and the new slots are left behind
+  const qsizetype oldSize{this->types.size()};
+  const qsizetype newSize{oldSize + indices.size()};
+  const auto expand = [&indices, oldSize, newSize](auto& column)
+  {
+    column.resize(newSize);
+    qsizetype in{oldSize - 1};
+    qsizetype next{indices.size() - 1};
+    for (qsizetype out{newSize - 1}; out > in; --out)
+    {
+      if (next >= 0 && indices.at(next) == out)
+      {
+        --next;
+        continue;
+      }
+      column[out] = std::move(column[in--]);
+    }
+  };
+
+  QVector<bool> selectedFlags(oldSize);
+  std::ranges::for_each(
+    this->selected,
+    [&selectedFlags](const int i)
+    {
+      selectedFlags[i] = true;
+    });
+
+  expand(this->types);
+  expand(this->pointArrays);
+  expand(this->rotations);
+  expand(this->styleIds);
+  expand(this->paths);
+  expand(this->pathValid);
+  expand(this->boundsCache);
+  expand(this->boundsValid);
+  expand(selectedFlags);
+
+  std::ranges::for_each(
+    std::views::iota(qsizetype{0}, indices.size()),
+    [this, &indices, &shapes, &selectedFlags](const qsizetype k)
+    {
+      const int i{indices.at(k)};
+      const Shape& s{shapes.at(k)};
+      this->types[i] = s.type;
+      this->pointArrays[i] = s.points;
+      this->rotations[i] = s.rotation;
+      this->styleIds[i] = this->addStyle(s.style);
+      this->paths[i] = QPainterPath{};
+      this->pathValid[i] = false;
+      this->boundsValid[i] = false;
+      selectedFlags[i] = false;
+    });
+
+  this->selectionBits.fill(0, (newSize + 63) / 64);
+  this->selected.clear();
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(newSize)),
+    [this, &selectedFlags](const int i)
+    {
+      this->setSelected(i, selectedFlags.at(i));
+    });
+}
+
+ShapeType ShapeStore::type(const int i) const
+{
+  return this->types.at(i);
+}
+
+const ShapeStore::Points& ShapeStore::points(const int i) const
+{
+  return this->pointArrays.at(i);
+}
+
+int ShapeStore::pointCount(const int i) const
+{
+  return pointCountOf(this->types.at(i));
+}
+
+qreal ShapeStore::rotation(const int i) const
+{
+  return this->rotations.at(i);
+}
+
+quint32 ShapeStore::styleIndex(const int i) const
+{
+  return this->styleIds.at(i);
+}
+
+const ShapeStyle& ShapeStore::style(const int i) const
+{
+  return this->styles.at(this->styleIds.at(i));
+}
+
+const QVector<ShapeStyle>& ShapeStore::styleTable() const
+{
+  return this->styles;
+}
+
+bool ShapeStore::isSelected(const int i) const
+{
+  return (this->selectionBits.at(i / 64) >> (i % 64)) & 1U;
+}
+
+void ShapeStore::setSelected(const int i, const bool selected)
+{
+  if (this->isSelected(i) == selected)
+  {
+    return;
+  }
+
+  const quint64 mask{quint64{1} << (i % 64)};
+  if (selected)
+  {
+    this->selectionBits[i / 64] |= mask;
+    this->selected.push_back(i);
+  }
+  else
+  {
+    this->selectionBits[i / 64] &= ~mask;
+    this->selected.removeOne(i);
+  }
+}
+
+void ShapeStore::clearSelection()
+{
+  std::ranges::for_each(
+    this->selected,
+    [this](const int i)
+    {
+      this->selectionBits[i / 64] &= ~(quint64{1} << (i % 64));
+    });
+  this->selected.clear();
+}
+
+bool ShapeStore::hasSelection() const
+{
+  return !this->selected.isEmpty();
+}
+
+qsizetype ShapeStore::selectionSize() const
+{
+  return this->selected.size();
+}
+
+const QVector<int>& ShapeStore::selection() const
+{
+  return this->selected;
+}
+
+QVector<int> ShapeStore::sortedSelection() const
+{
+  QVector<int> result{this->selected};
+  std::ranges::sort(result);
+  return result;
+}
+
+void ShapeStore::translate(const int i, const QPointF& delta)
+{
+  Points& pts{this->pointArrays[i]};
+  std::ranges::for_each(
+    pts | std::views::take(this->pointCount(i)),
+    [&delta](QPointF& p)
+    {
+      p += delta;
+    });
+  this->invalidateGeometry(i);
+}
+
+void ShapeStore::rotate(const int i, const qreal delta)
+{
+  this->rotations[i] += delta;
+  this->invalidateGeometry(i);
+}
+
+void ShapeStore::translate(const QVector<int>& indices, const QPointF& delta)
+{
+  static_assert(
+    sizeof(Points) == 2 * Shape::maxPoints * sizeof(qreal),
+    "Point arrays are handed to the kernels as plain coordinates");
+
+  // Unused trailing points move along, they are never read
+  qreal* const xy{reinterpret_cast<qreal*>(this->pointArrays.data())};
+  qsizetype run{0};
+  while (run < indices.size())
+  {
+    qsizetype end{run + 1};
+    while (end < indices.size() && indices.at(end) == indices.at(end - 1) + 1)
+    {
+      ++end;
+    }
+    GeometryKernels::translate(
+      xy + 2 * Shape::maxPoints * indices.at(run),
+      Shape::maxPoints * (end - run),
+      delta);
+    run = end;
+  }
+
+  std::ranges::for_each(
+    indices,
+    [this](const int i)
+    {
+      this->invalidateGeometry(i);
+    });
+}
+
+void ShapeStore::rotate(const QVector<int>& indices, const qreal delta)
+{
+  std::ranges::for_each(
+    indices,
+    [this, delta](const int i)
+    {
+      this->rotations[i] += delta;
+      this->invalidateGeometry(i);
+    });
+}
+
+const QPainterPath& ShapeStore::path(const int i) const
+{
+  this->updatePath(i);
+  return this->paths.at(i);
+}
+
+QRectF ShapeStore::bounds(const int i) const
+{
+  if (!this->boundsValid.at(i))
+  {
+    this->updateBounds(i);
+  }
+  // Mapped files are not checked when opened. An entry that is not finite,
+  // stored that way or built from such points, reads as empty
+  const QRectF& b{this->boundsCache.at(i)};
+  if (
+    !std::isfinite(b.x()) || !std::isfinite(b.y()) ||
+    !std::isfinite(b.width()) || !std::isfinite(b.height()))
+  {
+    return QRectF{};
+  }
+  return b;
+}
+
+QPointF ShapeStore::center(const int i) const
+{
+  return centerOf(this->types.at(i), this->pointArrays.at(i));
+}
+
+bool ShapeStore::hitTest(
+  const int i, const QPointF& p, const qreal tolerance) const
+{
+  const ShapeType t{this->types.at(i)};
+  const Points& pts{this->pointArrays.at(i)};
+  const qreal reach{this->style(i).width / 2.0 + tolerance};
+
+  // Undo the rotation about the center instead of rotating the shape
+  const QPointF c{centerOf(t, pts)};
+  const qreal angle{this->rotations.at(i)};
+  const qreal cosA{std::cos(angle)};
+  const qreal sinA{std::sin(angle)};
+  const QPointF d{p - c};
+  const QPointF q{
+    c.x() + d.x() * cosA + d.y() * sinA,
+    c.y() - d.x() * sinA + d.y() * cosA};
+
+  if (t == ShapeType::Triangle)
+  {
+    const QPointF& a{pts.at(0)};
+    const QPointF& b{pts.at(1)};
+    const QPointF& e{pts.at(2)};
+    const auto cross = [&q](const QPointF& u, const QPointF& v)
+    {
+      return (v.x() - u.x()) * (q.y() - u.y()) -
+             (v.y() - u.y()) * (q.x() - u.x());
+    };
+
+    // Inside when the point is on the same side of all three edges,
+    // whichever way the triangle was wound
+    const qreal ab{cross(a, b)};
+    const qreal be{cross(b, e)};
+    const qreal ea{cross(e, a)};
+    const bool inside{
+      (ab >= 0.0 && be >= 0.0 && ea >= 0.0) ||
+      (ab <= 0.0 && be <= 0.0 && ea <= 0.0)};
+    return inside || segmentDistance(q, a, b) <= reach ||
+           segmentDistance(q, b, e) <= reach ||
+           segmentDistance(q, e, a) <= reach;
+  }
+
+  const QRectF r{QRectF{pts.at(0), pts.at(1)}.normalized()};
+
+  if (t == ShapeType::Ellipse)
+  {
+    // The outline offset by reach is approximated by the ellipse with both
+    // radii grown by reach, which is exact for circles
+    const qreal rx{r.width() / 2.0 + reach};
+    const qreal ry{r.height() / 2.0 + reach};
+    if (rx <= 0.0 || ry <= 0.0)
+    {
+      return false;
+    }
+    const qreal nx{(q.x() - r.center().x()) / rx};
+    const qreal ny{(q.y() - r.center().y()) / ry};
+    return nx * nx + ny * ny <= 1.0;
+  }
+
+  const qreal dx{qMax(qMax(r.left() - q.x(), q.x() - r.right()), 0.0)};
+  const qreal dy{qMax(qMax(r.top() - q.y(), q.y() - r.bottom()), 0.0)};
+  return dx * dx + dy * dy <= reach * reach;
+}
+
+QVector<int> ShapeStore::hitTest(
+  const QPointF& p, const QVector<int>& candidates, const qreal tolerance)
+  const
+{
+  QVector<int> result{};
+  std::ranges::copy_if(
+    candidates,
+    std::back_inserter(result),
+    [this, &p, tolerance](const int i)
+    {
+      return this->hitTest(i, p, tolerance);
+    });
+  return result;
+}
+
+void ShapeStore::updateBounds() const
+{
+  QVector<int> stale{};
+  std::ranges::copy_if(
+    std::views::iota(0, static_cast<int>(this->types.size())),
+    std::back_inserter(stale),
+    [this](const int i)
+    {
+      return !this->boundsValid.at(i);
+    });
+  this->updateBounds(stale);
+}
+
+qsizetype ShapeStore::memoryUsage() const
+{
+  qsizetype bytes{0};
+  bytes += this->types.capacity() * sizeof(ShapeType);
+  bytes += this->pointArrays.capacity() * sizeof(Points);
+  bytes += this->rotations.capacity() * sizeof(qreal);
+  bytes += this->styleIds.capacity() * sizeof(quint32);
+  bytes += this->selectionBits.capacity() * sizeof(quint64);
+  bytes += this->selected.capacity() * sizeof(int);
+  bytes += this->styles.capacity() * sizeof(ShapeStyle);
+  bytes += this->styleLookup.capacity() * (sizeof(ShapeStyle) + 16);
+  bytes += this->paths.capacity() * sizeof(QPainterPath);
+  bytes += this->pathValid.capacity() * sizeof(bool);
+  bytes += this->boundsCache.capacity() * sizeof(QRectF);
+  bytes += this->boundsValid.capacity() * sizeof(bool);
+
+  // Built paths own a private element array; count the elements plus a
+  // rough allocation overhead
+  std::ranges::for_each(
+    this->paths,
+    [&bytes](const QPainterPath& path)
+    {
+      if (!path.isEmpty())
+      {
+        bytes += 64 + path.elementCount() * sizeof(QPainterPath::Element);
+      }
+    });
+
+  return bytes;
+}
+
+qreal ShapeStore::bytesPerShape() const
+{
+  if (this->types.isEmpty())
+  {
+    return 0.0;
+  }
+  return static_cast<qreal>(this->memoryUsage()) / this->types.size();
+}
+
+int ShapeStore::pointCountOf(const ShapeType type)
+{
+  return type == ShapeType::Triangle ? 3 : 2;
+}
+
+ShapeStore::ColumnViews ShapeStore::columns() const
+{
+  this->updateBounds();
+  return ColumnViews{
+    this->types.constData(),
+    this->pointArrays.constData(),
+    this->rotations.constData(),
+    this->styleIds.constData(),
+    this->boundsCache.constData(),
+    this->types.size()};
+}
+
+void ShapeStore::adopt(
+  const ColumnViews& views,
+  const QVector<ShapeStyle>& styles,
+  std::shared_ptr<const void> backing)
+{
+  this->clear();
+
+  const qsizetype n{views.count};
+  this->types.setView(views.types, n);
+  this->pointArrays.setView(views.points, n);
+  this->rotations.setView(views.rotations, n);
+  this->styleIds.setView(views.styleIds, n);
+  this->styles = styles;
+  // Older files may repeat a style, the first index is the one reused
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(styles.size())),
+    [this, &styles](const int i)
+    {
+      if (!this->styleLookup.contains(styles.at(i)))
+      {
+        this->styleLookup.insert(styles.at(i), static_cast<quint32>(i));
+      }
+    });
+  this->backing = std::move(backing);
+  this->selectionBits.fill(0, (n + 63) / 64);
+
+  this->paths.resize(n);
+  this->pathValid.fill(false, n);
+  if (views.bounds != nullptr)
+  {
+    this->boundsCache.setView(views.bounds, n);
+    this->boundsValid.fill(true, n);
+  }
+  else
+  {
+    this->boundsCache.resize(n);
+    this->boundsValid.fill(false, n);
+  }
+}
+
+void ShapeStore::detach()
+{
+  this->types.detach();
+  this->pointArrays.detach();
+  this->rotations.detach();
+  this->styleIds.detach();
+  this->boundsCache.detach();
+  this->backing.reset();
+}
+
+bool ShapeStore::isMapped() const
+{
+  return this->backing != nullptr;
+}
+
+quint32 ShapeStore::addStyle(const ShapeStyle& style)
+{
+  // Shapes are mostly drawn in runs with the same pen settings, the newest
+  // entry is checked before the lookup
+  if (!this->styles.isEmpty() && this->styles.last() == style)
+  {
+    return static_cast<quint32>(this->styles.size() - 1);
+  }
+  const auto known{this->styleLookup.constFind(style)};
+  if (known != this->styleLookup.cend())
+  {
+    return known.value();
+  }
+  const quint32 id{static_cast<quint32>(this->styles.size())};
+  this->styles.push_back(style);
+  this->styleLookup.insert(style, id);
+  return id;
+}
+
+void ShapeStore::updatePath(const int i) const
+{
+  if (this->pathValid.at(i))
+  {
+    return;
+  }
+  this->paths[i] = this->buildPath(i);
+  this->pathValid[i] = true;
+}
+
+QPainterPath ShapeStore::buildPath(const int i) const
+{
+  const ShapeType t{this->types.at(i)};
+  const Points& pts{this->pointArrays.at(i)};
+
+  const QPointF c{centerOf(t, pts)};
+  QPainterPath path{};
+
+  if (t == ShapeType::Triangle)
+  {
+    path.moveTo(pts.at(0));
+    path.lineTo(pts.at(1));
+    path.lineTo(pts.at(2));
+    path.closeSubpath();
+  }
+  else
+  {
+    const QRectF r{QRectF{pts.at(0), pts.at(1)}.normalized()};
+    if (t == ShapeType::Ellipse)
+    {
+      path.addEllipse(r);
+    }
+    else
+    {
+      path.addRect(r);
+    }
+  }
+
+  QTransform tr{};
+
+  tr.translate(c.x(), c.y());
+  tr.rotateRadians(this->rotations.at(i));
+  tr.translate(-c.x(), -c.y());
+
+  return tr.map(path);
+}
+
+void ShapeStore::updateBounds(const QVector<int>& indices) const
+{
+  // Rects, squares and ellipses go through the box kernel as columns,
+  // triangles turn their three corners
+  QVector<int> boxes{};
+  QVector<qreal> cx{};
+  QVector<qreal> cy{};
+  QVector<qreal> hx{};
+  QVector<qreal> hy{};
+  QVector<qreal> cosA{};
+  QVector<qreal> sinA{};
+  QVector<qreal> round{};
+
+  for (const int i : indices)
+  {
+    const ShapeType t{this->types.at(i)};
+    const Points& pts{this->pointArrays.at(i)};
+    const qreal angle{this->rotations.at(i)};
+
+    if (t == ShapeType::Triangle)
+    {
+      this->boundsCache[i] = triangleBounds(pts, angle);
+      this->boundsValid[i] = true;
+      continue;
+    }
+
+    const QRectF r{QRectF{pts.at(0), pts.at(1)}.normalized()};
+    boxes.push_back(i);
+    cx.push_back(r.center().x());
+    cy.push_back(r.center().y());
+    hx.push_back(r.width() / 2.0);
+    hy.push_back(r.height() / 2.0);
+    cosA.push_back(std::cos(angle));
+    sinA.push_back(std::sin(angle));
+    round.push_back(t == ShapeType::Ellipse ? 1.0 : 0.0);
+  }
+
+  if (boxes.isEmpty())
+  {
+    return;
+  }
+
+  const qsizetype n{boxes.size()};
+  QVector<qreal> out(4 * n);
+  GeometryKernels::rotatedBounds(
+    GeometryKernels::Boxes{
+      cx.constData(),
+      cy.constData(),
+      hx.constData(),
+      hy.constData(),
+      cosA.constData(),
+      sinA.constData(),
+      round.constData()},
+    n,
+    GeometryKernels::Bounds{
+      out.data(), out.data() + n, out.data() + 2 * n, out.data() + 3 * n});
+
+  std::ranges::for_each(
+    std::views::iota(qsizetype{0}, n),
+    [this, &boxes, &out, n](const qsizetype k)
+    {
+      const int i{boxes.at(k)};
+      this->boundsCache[i] = QRectF{
+        QPointF{out.at(k), out.at(n + k)},
+        QPointF{out.at(2 * n + k), out.at(3 * n + k)}};
+      this->boundsValid[i] = true;
+    });
+}
+
+void ShapeStore::updateBounds(const int i) const
+{
+  // The same kernel as the batch with columns of one on the stack, a
+  // stale shape met while painting must not allocate
+  const ShapeType t{this->types.at(i)};
+  const Points& pts{this->pointArrays.at(i)};
+  const qreal angle{this->rotations.at(i)};
+
+  if (t == ShapeType::Triangle)
+  {
+    this->boundsCache[i] = triangleBounds(pts, angle);
+    this->boundsValid[i] = true;
+    return;
+  }
+
+  const QRectF r{QRectF{pts.at(0), pts.at(1)}.normalized()};
+  const qreal cx{r.center().x()};
+  const qreal cy{r.center().y()};
+  const qreal hx{r.width() / 2.0};
+  const qreal hy{r.height() / 2.0};
+  const qreal cosA{std::cos(angle)};
+  const qreal sinA{std::sin(angle)};
+  const qreal round{t == ShapeType::Ellipse ? 1.0 : 0.0};
+  qreal out[4];
+  GeometryKernels::rotatedBounds(
+    GeometryKernels::Boxes{&cx, &cy, &hx, &hy, &cosA, &sinA, &round},
+    1,
+    GeometryKernels::Bounds{out, out + 1, out + 2, out + 3});
+  this->boundsCache[i] =
+    QRectF{QPointF{out[0], out[1]}, QPointF{out[2], out[3]}};
+  this->boundsValid[i] = true;
+}
+
+QRectF ShapeStore::triangleBounds(const Points& pts, const qreal angle)
+{
+  Points turned{pts};
+  GeometryKernels::rotate(
+    reinterpret_cast<qreal*>(turned.data()),
+    Shape::maxPoints,
+    centerOf(ShapeType::Triangle, pts),
+    angle);
+  const auto [minX, maxX]{
+    std::ranges::minmax(turned | std::views::transform(&QPointF::x))};
+  const auto [minY, maxY]{
+    std::ranges::minmax(turned | std::views::transform(&QPointF::y))};
+  return QRectF{QPointF{minX, minY}, QPointF{maxX, maxY}};
+}
+
+QPointF ShapeStore::centerOf(const ShapeType type, const Points& pts)
+{
+  if (type == ShapeType::Triangle)
+  {
+    return (pts.at(0) + pts.at(1) + pts.at(2)) / 3.0;
+  }
+  return QRectF{pts.at(0), pts.at(1)}.center();
+}
+
+qreal ShapeStore::segmentDistance(
+  const QPointF& p, const QPointF& a, const QPointF& b)
+{
+  const QPointF ab{b - a};
+  const qreal length2{QPointF::dotProduct(ab, ab)};
+  const qreal t{
+    length2 > 0.0 ? qBound(0.0, QPointF::dotProduct(p - a, ab) / length2, 1.0)
+                  : 0.0};
+  const QPointF d{p - (a + ab * t)};
+  return std::sqrt(QPointF::dotProduct(d, d));
+}
+
+void ShapeStore::invalidateGeometry(const int i)
+{
+  this->pathValid[i] = false;
+  this->boundsValid[i] = false;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "column.hpp"
+
+#include <QColor>
+#include <QHash>
+#include <QPainterPath>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+// C++ standard
+#include <array>
+#include <memory>
+
+// Numbering matches PaintCanvas::ToolType, it is what the files store
+enum class ShapeType : quint8
+{
+  Square = 1,
+  Rect = 2,
+  Triangle = 3,
+  Ellipse = 4,
+};
+
+struct ShapeStyle
+{
+  QColor pen{Qt::black};
+  QColor fill{Qt::gray};
+  int width{3};
+
+  bool operator==(const ShapeStyle& other) const = default;
+};
+
+inline size_t qHash(const ShapeStyle& style, const size_t seed = 0)
+{
+  return qHashMulti(seed, style.pen.rgba(), style.fill.rgba(), style.width);
+}
+
+// One shape by value. The store never keeps these, it is only used to hand
+// shapes in and out of it
+struct Shape
+{
+  static constexpr int maxPoints{3};
+
+  ShapeType type{ShapeType::Rect};
+  std::array<QPointF, maxPoints> points{};
+  qreal rotation{0.0};
+  ShapeStyle style{};
+};
+
+// Structure-of-arrays scene storage. Each column is one contiguous array
+// indexed by the shape position, which is also the drawing order. Geometry
+// lives inline (at most three points), styles are interned in a table that
+// holds each distinct style once, drawings rarely have more than a few. The
+// transformed path, bounds and center are cached per shape and rebuilt
+// lazily after type, points or rotation change; bounds come straight from
+// the points through the batch kernels, so indexing a scene never has to
+// build its paths. The selection is kept both as a bitset for membership
+// tests and as a list of positions, so work on the selected shapes never
+// has to scan the whole scene. The columns may view memory the store does
+// not own, such as a mapped scene file; they are copied on the first write.
+class ShapeStore
+{
+public:
+  using Points = std::array<QPointF, Shape::maxPoints>;
+
+  qsizetype size() const;
+  bool isEmpty() const;
+  void clear();
+  void reserve(const qsizetype n);
+
+  int append(const Shape& s);
+  Shape shape(const int i) const;
+  // Indices have to be sorted ascending
+  void remove(const QVector<int>& indices);
+  // Puts shapes[k] at position indices[k], indices sorted ascending and
+  // counted after the insertion. Reverses remove() given what it removed
+  void insert(const QVector<int>& indices, const QVector<Shape>& shapes);
+
+  ShapeType type(const int i) const;
+  const Points& points(const int i) const;
+  int pointCount(const int i) const;
+  qreal rotation(const int i) const;
+  quint32 styleIndex(const int i) const;
+  const ShapeStyle& style(const int i) const;
+  // Styles referenced by styleIndex, each distinct style once. Entries stay
+  // when their last shape goes, so indices remain valid until clear()
+  const QVector<ShapeStyle>& styleTable() const;
+
+  bool isSelected(const int i) const;
+  void setSelected(const int i, const bool selected);
+  // Cost is proportional to the number of selected shapes
+  void clearSelection();
+  bool hasSelection() const;
+  qsizetype selectionSize() const;
+  // Selected positions in the order they were selected
+  const QVector<int>& selection() const;
+  // Selected positions in drawing order
+  QVector<int> sortedSelection() const;
+
+  void translate(const int i, const QPointF& delta);
+  void rotate(const int i, const qreal delta);
+  // Batch versions, indices have to be sorted ascending. Runs of adjacent
+  // shapes are translated with one kernel call
+  void translate(const QVector<int>& indices, const QPointF& delta);
+  void rotate(const QVector<int>& indices, const qreal delta);
+
+  const QPainterPath& path(const int i) const;
+  // Cached paths belong to the thread owning the store: copies share them,
+  // and QPainter prepares data inside a path it draws without a lock.
+  // Other threads build their own, which reads the store only
+  QPainterPath buildPath(const int i) const;
+  // Empty for shapes whose bounds are not finite
+  QRectF bounds(const int i) const;
+  QPointF center(const int i) const;
+  // Exact point tests on the shape outline, no path is built. The
+  // tolerance extends the outer edge of the stroke, so a point counts when
+  // it is inside or within width / 2 + tolerance of the outline
+  bool hitTest(const int i, const QPointF& p, const qreal tolerance) const;
+  // Candidates that contain the point, in the order they were given
+  QVector<int> hitTest(
+    const QPointF& p, const QVector<int>& candidates, const qreal tolerance)
+    const;
+
+  // Recomputes every stale bounds entry in one batch, needed before
+  // handing the store to threads that must not write to it
+  void updateBounds() const;
+
+  // Approximate heap footprint of all columns, caches and the style table
+  qsizetype memoryUsage() const;
+  qreal bytesPerShape() const;
+
+  static int pointCountOf(const ShapeType type);
+
+  // Raw columns, all of count entries. Bounds are the cached rotated
+  // bounds and may be null when handed to adopt
+  struct ColumnViews
+  {
+    const ShapeType* types{nullptr};
+    const Points* points{nullptr};
+    const qreal* rotations{nullptr};
+    const quint32* styleIds{nullptr};
+    const QRectF* bounds{nullptr};
+    qsizetype count{0};
+  };
+
+  // Brings the bounds up to date first
+  ColumnViews columns() const;
+  // Replaces the scene with columns living in memory owned by backing,
+  // typically a mapped file. Nothing is copied; backing is kept alive by
+  // this store and its copies until the first write to a column copies it.
+  // The style ids have to be valid indices into styles
+  void adopt(
+    const ColumnViews& views,
+    const QVector<ShapeStyle>& styles,
+    std::shared_ptr<const void> backing);
+  // Copies every viewed column and lets go of the backing memory
+  void detach();
+  bool isMapped() const;
+
+private:
+  Column<ShapeType> types{};
+  Column<Points> pointArrays{};
+  Column<qreal> rotations{};
+  Column<quint32> styleIds{};
+  QVector<quint64> selectionBits{};
+  QVector<int> selected{};
+  QVector<ShapeStyle> styles{};
+  QHash<ShapeStyle, quint32> styleLookup{};
+  std::shared_ptr<const void> backing{};
+
+  mutable QVector<QPainterPath> paths{};
+  mutable QVector<bool> pathValid{};
+  mutable Column<QRectF> boundsCache{};
+  mutable QVector<bool> boundsValid{};
+
+  quint32 addStyle(const ShapeStyle& style);
+  static QPointF centerOf(const ShapeType type, const Points& pts);
+  static qreal segmentDistance(
+    const QPointF& p, const QPointF& a, const QPointF& b);
+  void updatePath(const int i) const;
+  void updateBounds(const QVector<int>& indices) const;
+  void updateBounds(const int i) const;
+  static QRectF triangleBounds(const Points& pts, const qreal angle);
+  void invalidateGeometry(const int i);
+};
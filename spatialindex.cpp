@@ -0,0 +1,263 @@
+#include "spatialindex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+SpatialIndex::SpatialIndex(const qreal cellSize) : cellSize{cellSize}
+{
+}
+
+void SpatialIndex::clear()
+{
+  this->cells.clear();
+  this->items.clear();
+  this->oversized.clear();
+}
+
+void SpatialIndex::insert(const int key, const QRectF& bounds)
+{
+  if (this->contains(key))
+  {
+    this->remove(key);
+  }
+
+  Item item{};
+  item.key = key;
+  item.bounds = bounds.normalized();
+  item.range = this->cellRange(item.bounds);
+
+  if (isOversized(item.range))
+  {
+    this->oversized.push_back(item);
+  }
+  else
+  {
+    for (int y{item.range.y0}; y <= item.range.y1; ++y)
+    {
+      for (int x{item.range.x0}; x <= item.range.x1; ++x)
+      {
+        this->cells[cellKey(x, y)].push_back(item);
+      }
+    }
+  }
+
+  this->items.insert(key, item);
+}
+
+void SpatialIndex::remove(const int key)
+{
+  const auto found{this->items.constFind(key)};
+  if (found == this->items.cend())
+  {
+    return;
+  }
+
+  const CellRange range{found->range};
+  const auto sameKey = [key](const Item& item)
+  {
+    return item.key == key;
+  };
+
+  if (isOversized(range))
+  {
+    erase_if(this->oversized, sameKey);
+  }
+  else
+  {
+    for (int y{range.y0}; y <= range.y1; ++y)
+    {
+      for (int x{range.x0}; x <= range.x1; ++x)
+      {
+        const auto cell{this->cells.find(cellKey(x, y))};
+        if (cell == this->cells.end())
+        {
+          continue;
+        }
+        erase_if(cell.value(), sameKey);
+        if (cell->isEmpty())
+        {
+          this->cells.erase(cell);
+        }
+      }
+    }
+  }
+
+  this->items.remove(key);
+}
+
+void SpatialIndex::update(const int key, const QRectF& bounds)
+{
+  this->insert(key, bounds);
+}
+
+bool SpatialIndex::contains(const int key) const
+{
+  return this->items.contains(key);
+}
+
+QRectF SpatialIndex::bounds(const int key) const
+{
+  return this->items.value(key).bounds;
+}
+
+qsizetype SpatialIndex::size() const
+{
+  return this->items.size();
+}
+
+QVector<int> SpatialIndex::query(const QPointF& p) const
+{
+  QVector<int> result{};
+
+  const auto containsPoint = [&p](const Item& item)
+  {
+    return item.bounds.left() <= p.x() && p.x() <= item.bounds.right() &&
+           item.bounds.top() <= p.y() && p.y() <= item.bounds.bottom();
+  };
+
+  const auto cell{this->cells.constFind(
+    cellKey(this->cellCoord(p.x()), this->cellCoord(p.y())))};
+  if (cell != this->cells.cend())
+  {
+    std::ranges::for_each(
+      *cell,
+      [&result, &containsPoint](const Item& item)
+      {
+        if (containsPoint(item))
+        {
+          result.push_back(item.key);
+        }
+      });
+  }
+
+  std::ranges::for_each(
+    this->oversized,
+    [&result, &containsPoint](const Item& item)
+    {
+      if (containsPoint(item))
+      {
+        result.push_back(item.key);
+      }
+    });
+
+  return result;
+}
+
+QVector<int> SpatialIndex::query(const QRectF& rect) const
+{
+  QVector<int> result{};
+  this->query(rect, result);
+  return result;
+}
+
+void SpatialIndex::query(const QRectF& rect, QVector<int>& result) const
+{
+  result.clear();
+  const QRectF r{rect.normalized()};
+  const CellRange q{this->cellRange(r)};
+
+  // An item spanning several cells is reported only from the first cell it
+  // shares with the query, so no de-duplication pass is needed
+  const auto visitCell = [&result, &r, &q](
+                           const int x, const int y, const QVector<Item>& cell)
+  {
+    std::ranges::for_each(
+      cell,
+      [&result, &r, &q, x, y](const Item& item)
+      {
+        if (
+          x == qMax(item.range.x0, q.x0) && y == qMax(item.range.y0, q.y0) &&
+          overlaps(item.bounds, r))
+        {
+          result.push_back(item.key);
+        }
+      });
+  };
+
+  const qint64 queryCells{
+    (static_cast<qint64>(q.x1) - q.x0 + 1) *
+    (static_cast<qint64>(q.y1) - q.y0 + 1)};
+
+  if (queryCells > this->cells.size())
+  {
+    // Large query over a sparse grid: walk the occupied cells instead
+    for (auto it{this->cells.cbegin()}; it != this->cells.cend(); ++it)
+    {
+      const int x{static_cast<qint32>(static_cast<quint32>(it.key() >> 32))};
+      const int y{static_cast<qint32>(static_cast<quint32>(it.key()))};
+      if (x >= q.x0 && x <= q.x1 && y >= q.y0 && y <= q.y1)
+      {
+        visitCell(x, y, it.value());
+      }
+    }
+  }
+  else
+  {
+    for (int y{q.y0}; y <= q.y1; ++y)
+    {
+      for (int x{q.x0}; x <= q.x1; ++x)
+      {
+        const auto cell{this->cells.constFind(cellKey(x, y))};
+        if (cell != this->cells.cend())
+        {
+          visitCell(x, y, cell.value());
+        }
+      }
+    }
+  }
+
+  std::ranges::for_each(
+    this->oversized,
+    [&result, &r](const Item& item)
+    {
+      if (overlaps(item.bounds, r))
+      {
+        result.push_back(item.key);
+      }
+    });
+}
+
+SpatialIndex::CellRange SpatialIndex::cellRange(const QRectF& r) const
+{
+  CellRange range{};
+  range.x0 = this->cellCoord(r.left());
+  range.y0 = this->cellCoord(r.top());
+  range.x1 = this->cellCoord(r.right());
+  range.y1 = this->cellCoord(r.bottom());
+  return range;
+}
+
+int SpatialIndex::cellCoord(const qreal v) const
+{
+  // Keep far away coordinates from overflowing the packed cell key. NaN
+  // fails every comparison, it is given a cell instead of converted
+  constexpr qreal limit{std::numeric_limits<int>::max() / 2};
+  if (std::isnan(v))
+  {
+    return 0;
+  }
+  return static_cast<int>(
+    qBound(-limit, std::floor(v / this->cellSize), limit));
+}
+
+quint64 SpatialIndex::cellKey(const int x, const int y)
+{
+  return (static_cast<quint64>(static_cast<quint32>(x)) << 32) |
+         static_cast<quint32>(y);
+}
+
+bool SpatialIndex::overlaps(const QRectF& a, const QRectF& b)
+{
+  // Inclusive on purpose: a zero sized rubber band still has to find the
+  // shapes it touches, QRectF::intersects rejects empty rectangles
+  return a.left() <= b.right() && b.left() <= a.right() &&
+         a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+bool SpatialIndex::isOversized(const CellRange& range)
+{
+  const qint64 w{static_cast<qint64>(range.x1) - range.x0 + 1};
+  const qint64 h{static_cast<qint64>(range.y1) - range.y0 + 1};
+  return w * h > maxCellsPerItem;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+// Uniform grid over shape bounding rectangles. The owner chooses the integer
+// keys and keeps them in sync; queries only return candidates whose bounds
+// touch the query, the exact geometry test is left to the caller.
+class SpatialIndex
+{
+public:
+  explicit SpatialIndex(const qreal cellSize = 64.0);
+
+  void clear();
+  void insert(const int key, const QRectF& bounds);
+  void remove(const int key);
+  void update(const int key, const QRectF& bounds);
+  bool contains(const int key) const;
+  // Bounds the key was last inserted or updated with, empty if unknown
+  QRectF bounds(const int key) const;
+  qsizetype size() const;
+
+  // Candidates are returned in no particular order and without duplicates
+  QVector<int> query(const QPointF& p) const;
+  QVector<int> query(const QRectF& rect) const;
+  // Replaces the contents of result, which keeps its capacity between calls
+  void query(const QRectF& rect, QVector<int>& result) const;
+
+private:
+  struct CellRange
+  {
+    int x0{0};
+    int y0{0};
+    int x1{-1};
+    int y1{-1};
+  };
+
+  struct Item
+  {
+    int key{-1};
+    QRectF bounds{};
+    CellRange range{};
+  };
+
+  // Shapes covering more cells than this are kept in a flat list instead of
+  // being smeared over the grid
+  static constexpr int maxCellsPerItem{256};
+
+  qreal cellSize{64.0};
+  QHash<quint64, QVector<Item>> cells{};
+  QHash<int, Item> items{};
+  QVector<Item> oversized{};
+
+  CellRange cellRange(const QRectF& r) const;
+  int cellCoord(const qreal v) const;
+  static quint64 cellKey(const int x, const int y);
+  static bool overlaps(const QRectF& a, const QRectF& b);
+  static bool isOversized(const CellRange& range);
+};
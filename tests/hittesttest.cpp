@@ -0,0 +1,168 @@
+// ShapeStore::hitTest answers from the shape parameters without building a
+// path, it has to agree with the path the canvas draws. Run through ctest
+// or on its own:
+//   hittesttest -platform offscreen
+
+#include "scenegenerator.hpp"
+#include "shapestore.hpp"
+
+#include <QPainterPath>
+#include <QRandomGenerator>
+#include <QTest>
+#include <QtMath>
+
+namespace
+{
+ShapeStore makeShape(
+  const ShapeType type,
+  const QPointF& a,
+  const QPointF& b,
+  const QPointF& c,
+  const qreal rotation,
+  const int width)
+{
+  Shape s{};
+  s.type = type;
+  s.points = {a, b, c};
+  s.rotation = rotation;
+  s.style.width = width;
+  ShapeStore store{};
+  store.append(s);
+  return store;
+}
+} // namespace
+
+class HitTestTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void matchesPath();
+  void strokeReachSquare();
+  void strokeReachRect();
+  void strokeReachEllipse();
+  void strokeReachTriangle();
+};
+
+void HitTestTest::matchesPath()
+{
+  const ShapeStore shapes{makeScene(300, QSizeF{1000.0, 1000.0})};
+  QRandomGenerator rng{11};
+  // Points this close to the outline are left out, the path flattens
+  // ellipses into curves and the edges themselves are a matter of rounding
+  const qreal edge{0.5};
+  int inside{0};
+  int outside{0};
+
+  for (int i{0}; i < shapes.size(); ++i)
+  {
+    const QPainterPath& path{shapes.path(i)};
+    const QRectF area{path.boundingRect().adjusted(-4.0, -4.0, 4.0, 4.0)};
+    // With no reach only the outline itself counts, not the stroke
+    const qreal tolerance{-shapes.style(i).width / 2.0};
+
+    for (int k{0}; k < 64; ++k)
+    {
+      const QPointF p{
+        area.left() + rng.bounded(area.width()),
+        area.top() + rng.bounded(area.height())};
+      const QRectF box{
+        p.x() - edge, p.y() - edge, 2.0 * edge, 2.0 * edge};
+      const bool contained{path.contains(box)};
+      if (!contained && path.intersects(box))
+      {
+        continue;
+      }
+
+      if (shapes.hitTest(i, p, tolerance) != path.contains(p))
+      {
+        QFAIL(qPrintable(QString{"Shape %1 disagrees at %2, %3"}
+                           .arg(i)
+                           .arg(p.x())
+                           .arg(p.y())));
+      }
+      ++(contained ? inside : outside);
+    }
+  }
+
+  // Both answers have to be exercised, not just the easy one
+  QVERIFY(inside > 1000);
+  QVERIFY(outside > 1000);
+}
+
+void HitTestTest::strokeReachSquare()
+{
+  // Turned by 45 degrees the top corner sits 20 * sqrt(2) above the center
+  const ShapeStore shapes{makeShape(
+    ShapeType::Square, {0.0, 0.0}, {40.0, 40.0}, {}, M_PI / 4.0, 6)};
+  const qreal corner{20.0 - 20.0 * M_SQRT2};
+  QVERIFY(shapes.hitTest(0, QPointF{20.0, corner - 2.5}, 0.0));
+  QVERIFY(!shapes.hitTest(0, QPointF{20.0, corner - 3.5}, 0.0));
+  // The corner of the unrotated square is well outside
+  QVERIFY(!shapes.hitTest(0, QPointF{0.0, 0.0}, 0.0));
+  // The tolerance adds to half the width
+  QVERIFY(shapes.hitTest(0, QPointF{20.0, corner - 3.5}, 1.0));
+}
+
+void HitTestTest::strokeReachRect()
+{
+  const ShapeStore shapes{makeShape(
+    ShapeType::Rect, {0.0, 0.0}, {100.0, 50.0}, {}, 0.0, 10)};
+  QVERIFY(shapes.hitTest(0, QPointF{104.0, 25.0}, 0.0));
+  QVERIFY(!shapes.hitTest(0, QPointF{106.0, 25.0}, 0.0));
+  QVERIFY(shapes.hitTest(0, QPointF{50.0, 25.0}, 0.0));
+
+  // Upright about the center (50, 25) it spans -25 to 75 vertically
+  const ShapeStore turned{makeShape(
+    ShapeType::Rect, {0.0, 0.0}, {100.0, 50.0}, {}, M_PI / 2.0, 10)};
+  QVERIFY(turned.hitTest(0, QPointF{50.0, -29.0}, 0.0));
+  QVERIFY(!turned.hitTest(0, QPointF{50.0, -31.0}, 0.0));
+  QVERIFY(!turned.hitTest(0, QPointF{104.0, 25.0}, 0.0));
+}
+
+void HitTestTest::strokeReachEllipse()
+{
+  const ShapeStore shapes{makeShape(
+    ShapeType::Ellipse, {0.0, 0.0}, {200.0, 100.0}, {}, 0.0, 10)};
+  QVERIFY(shapes.hitTest(0, QPointF{204.0, 50.0}, 0.0));
+  QVERIFY(!shapes.hitTest(0, QPointF{206.0, 50.0}, 0.0));
+  QVERIFY(shapes.hitTest(0, QPointF{100.0, -4.0}, 0.0));
+  QVERIFY(!shapes.hitTest(0, QPointF{100.0, -6.0}, 0.0));
+
+  // Upright about the center (100, 50) it spans -50 to 150 vertically
+  const ShapeStore turned{makeShape(
+    ShapeType::Ellipse, {0.0, 0.0}, {200.0, 100.0}, {}, M_PI / 2.0, 10)};
+  QVERIFY(turned.hitTest(0, QPointF{100.0, -54.0}, 0.0));
+  QVERIFY(!turned.hitTest(0, QPointF{100.0, -60.0}, 0.0));
+  QVERIFY(!turned.hitTest(0, QPointF{204.0, 50.0}, 0.0));
+}
+
+void HitTestTest::strokeReachTriangle()
+{
+  // Half the width plus the tolerance reaches 3 pixels past the outline
+  const ShapeStore shapes{makeShape(
+    ShapeType::Triangle,
+    {0.0, 0.0},
+    {100.0, 0.0},
+    {0.0, 100.0},
+    0.0,
+    4)};
+  QVERIFY(shapes.hitTest(0, QPointF{50.0, -2.5}, 1.0));
+  QVERIFY(!shapes.hitTest(0, QPointF{50.0, -3.5}, 1.0));
+  QVERIFY(shapes.hitTest(0, QPointF{10.0, 10.0}, 1.0));
+  QVERIFY(!shapes.hitTest(0, QPointF{60.0, 60.0}, 1.0));
+
+  // Half a turn about the centroid puts the hypotenuse near the origin
+  const ShapeStore turned{makeShape(
+    ShapeType::Triangle,
+    {0.0, 0.0},
+    {100.0, 0.0},
+    {0.0, 100.0},
+    M_PI,
+    4)};
+  QVERIFY(!turned.hitTest(0, QPointF{10.0, 10.0}, 1.0));
+  QVERIFY(turned.hitTest(0, QPointF{60.0, 60.0}, 1.0));
+}
+
+QTEST_MAIN(HitTestTest)
+#include "hittesttest.moc"
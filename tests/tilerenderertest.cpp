@@ -0,0 +1,157 @@
+// Tiled rendering has to produce the very pixels one painter covering the
+// whole image produces. Run through ctest or on its own:
+//   tilerenderertest -platform offscreen
+
+#include "paintstyles.hpp"
+#include "scenegenerator.hpp"
+#include "scenesnapshot.hpp"
+#include "tilerenderer.hpp"
+
+#include <QImage>
+#include <QPainter>
+#include <QTest>
+
+// C++ standard
+#include <algorithm>
+#include <cstring>
+#include <ranges>
+
+namespace
+{
+// Not a multiple of any tile size below, the last column and row of tiles
+// are cut off
+const QSize imageSize{1000, 700};
+
+SceneSnapshot makeSnapshot(const bool fill)
+{
+  SceneSnapshot snapshot{};
+  snapshot.shapes = makeScene(3000, QSizeF{imageSize});
+  snapshot.shapes.updateBounds();
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(snapshot.shapes.size())),
+    [&snapshot](const int i)
+    {
+      snapshot.index.insert(i, snapshot.shapes.bounds(i));
+      snapshot.maxShapeWidth =
+        qMax(snapshot.maxShapeWidth, snapshot.shapes.style(i).width);
+    });
+  snapshot.settings.fill = fill;
+  snapshot.size = imageSize;
+  return snapshot;
+}
+
+// Every shape in order through one painter, as toImage drew before tiling
+QImage renderWhole(const SceneSnapshot& snapshot)
+{
+  QImage target{snapshot.size, QImage::Format_ARGB32_Premultiplied};
+  target.fill(Qt::white);
+  QPainter p{&target};
+  p.setRenderHint(QPainter::Antialiasing, true);
+  PaintStyles styles{};
+  std::ranges::for_each(
+    std::views::iota(0, static_cast<int>(snapshot.shapes.size())),
+    [&snapshot, &p, &styles](const int i)
+    {
+      SceneSnapshot::drawShape(
+        p, snapshot.shapes, i, snapshot.settings.fill, styles);
+    });
+  return target;
+}
+
+// QImage::operator== compares pixels; the buffers are compared as well,
+// padding excepted
+void compareBytes(const QImage& actual, const QImage& expected)
+{
+  QCOMPARE(actual.size(), expected.size());
+  QCOMPARE(actual.format(), expected.format());
+  const qsizetype rowBytes{qsizetype{expected.width()} * 4};
+  for (int y{0}; y < expected.height(); ++y)
+  {
+    if (
+      std::memcmp(
+        actual.constScanLine(y), expected.constScanLine(y), rowBytes) != 0)
+    {
+      QFAIL(qPrintable(QString{"Row %1 differs"}.arg(y)));
+    }
+  }
+}
+} // namespace
+
+class TileRendererTest : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void tileSizeIsClamped();
+  void matchesSinglePainter_data();
+  void matchesSinglePainter();
+  void snapshotMatchesSinglePainter_data();
+  void snapshotMatchesSinglePainter();
+};
+
+void TileRendererTest::tileSizeIsClamped()
+{
+  QCOMPARE(TileRenderer{0}.getTileSize(), 16);
+  QCOMPARE(TileRenderer{-5}.getTileSize(), 16);
+  TileRenderer renderer{};
+  renderer.setTileSize(1);
+  QCOMPARE(renderer.getTileSize(), 16);
+}
+
+void TileRendererTest::matchesSinglePainter_data()
+{
+  QTest::addColumn<int>("tileSize");
+  QTest::addColumn<bool>("fill");
+  QTest::newRow("16") << 16 << false;
+  QTest::newRow("100") << 100 << true;
+  QTest::newRow("256") << 256 << false;
+  QTest::newRow("256 filled") << 256 << true;
+  QTest::newRow("333") << 333 << true;
+  // One tile larger than the image
+  QTest::newRow("2048") << 2048 << false;
+}
+
+void TileRendererTest::matchesSinglePainter()
+{
+  QFETCH(int, tileSize);
+  QFETCH(bool, fill);
+  const SceneSnapshot snapshot{makeSnapshot(fill)};
+
+  // Each tile draws every shape, the painter clips to the tile
+  const QImage tiled{TileRenderer{tileSize}.render(
+    snapshot.size,
+    Qt::white,
+    [&snapshot](QPainter& p, const QRect&)
+    {
+      p.setRenderHint(QPainter::Antialiasing, true);
+      thread_local PaintStyles styles{};
+      std::ranges::for_each(
+        std::views::iota(0, static_cast<int>(snapshot.shapes.size())),
+        [&snapshot, &p](const int i)
+        {
+          SceneSnapshot::drawShapeOnWorker(
+            p, snapshot.shapes, i, snapshot.settings.fill, styles);
+        });
+    })};
+
+  compareBytes(tiled, renderWhole(snapshot));
+}
+
+void TileRendererTest::snapshotMatchesSinglePainter_data()
+{
+  QTest::addColumn<bool>("fill");
+  QTest::newRow("outlines") << false;
+  QTest::newRow("filled") << true;
+}
+
+void TileRendererTest::snapshotMatchesSinglePainter()
+{
+  // The toImage path: tiles of the default size, each drawing only what
+  // the index finds under it
+  QFETCH(bool, fill);
+  const SceneSnapshot snapshot{makeSnapshot(fill)};
+  compareBytes(snapshot.render(), renderWhole(snapshot));
+}
+
+QTEST_MAIN(TileRendererTest)
+#include "tilerenderertest.moc"
@@ -0,0 +1,286 @@
+#include "tilecache.hpp"
+#include "traceevents.hpp"
+
+#include <QThread>
+#include <QtMath>
+
+// C++ standard
+#include <algorithm>
+#include <ranges>
+
+TileCache::TileCache(QObject* const parent) : QObject{parent}
+{
+  // The GUI thread keeps drawing what is missing meanwhile
+  this->pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+TileCache::~TileCache()
+{
+  this->pool.clear();
+  this->pool.waitForDone();
+}
+
+qreal TileCache::levelZoom(const int level)
+{
+  return qPow(2.0, static_cast<qreal>(level) / levelsPerOctave);
+}
+
+qsizetype TileCache::getMemoryLimit() const
+{
+  return this->memoryLimit;
+}
+
+void TileCache::setMemoryLimit(const qsizetype newMemoryLimit)
+{
+  this->memoryLimit = qMax(qsizetype{0}, newMemoryLimit);
+  this->evict();
+}
+
+qsizetype TileCache::memoryUsage() const
+{
+  return this->memory;
+}
+
+qsizetype TileCache::size() const
+{
+  return this->tiles.size();
+}
+
+QRegion TileCache::draw(
+  QPainter& p,
+  const QRegion& region,
+  const int level,
+  const QPoint& origin,
+  const qreal dpr)
+{
+  this->useRatio(dpr);
+
+  QRegion found{};
+  const QRect range{tileRange(region.boundingRect(), origin)};
+  for (int y{range.top()}; y <= range.bottom(); ++y)
+  {
+    for (int x{range.left()}; x <= range.right(); ++x)
+    {
+      const QRect target{
+        origin + QPoint{x * tileSize, y * tileSize},
+        QSize{tileSize, tileSize}};
+      if (!region.intersects(target))
+      {
+        continue;
+      }
+      const auto tile{this->tiles.find(Key{level, x, y})};
+      if (tile == this->tiles.end())
+      {
+        continue;
+      }
+      // The image carries the pixel ratio, it is copied pixel for pixel
+      p.drawImage(target.topLeft(), tile->image);
+      tile->used = ++this->useCounter;
+      found += target;
+    }
+  }
+  if (found.isEmpty())
+  {
+    return region;
+  }
+  return region.subtracted(found);
+}
+
+void TileCache::request(
+  const QRect& rect,
+  const int level,
+  const QPoint& origin,
+  const qreal dpr,
+  const SceneSnapshot& scene)
+{
+  this->useRatio(dpr);
+  if (level != this->requestedLevel)
+  {
+    // Tiles of a level no longer shown are not worth finishing
+    this->pool.clear();
+    this->pending.clear();
+    this->requestedLevel = level;
+  }
+
+  const QRect range{tileRange(rect, origin)};
+  for (int y{range.top()}; y <= range.bottom(); ++y)
+  {
+    for (int x{range.left()}; x <= range.right(); ++x)
+    {
+      const Key key{level, x, y};
+      if (this->tiles.contains(key) || this->pending.contains(key))
+      {
+        continue;
+      }
+      const quint64 ticket{++this->ticketCounter};
+      this->pending.insert(key, ticket);
+      this->pool.start(
+        [this, scene, key, ticket, dpr]()
+        {
+          const QImage image{render(scene, key, dpr)};
+          QMetaObject::invokeMethod(
+            this,
+            [this, key, ticket, image]()
+            {
+              this->finish(key, ticket, image);
+            },
+            Qt::QueuedConnection);
+        });
+    }
+  }
+}
+
+void TileCache::invalidate(const QRectF& sceneRect)
+{
+  // Renders of other tiles started from the old scene still show the
+  // same pixels and are kept
+  this->pending.removeIf(
+    [&sceneRect](const QHash<Key, quint64>::iterator& tile)
+    {
+      return sceneArea(tile.key()).intersects(sceneRect);
+    });
+  this->tiles.removeIf(
+    [this, &sceneRect](const QHash<Key, Tile>::iterator& tile)
+    {
+      if (!sceneArea(tile.key()).intersects(sceneRect))
+      {
+        return false;
+      }
+      this->memory -= tile->image.sizeInBytes();
+      return true;
+    });
+}
+
+void TileCache::clear()
+{
+  this->pending.clear();
+  this->tiles.clear();
+  this->memory = 0;
+}
+
+void TileCache::useRatio(const qreal newDpr)
+{
+  if (newDpr != this->dpr)
+  {
+    // Moved to a screen of another pixel ratio, the old tiles are too
+    // coarse or too fine
+    this->clear();
+    this->dpr = newDpr;
+  }
+}
+
+void TileCache::finish(
+  const Key& key, const quint64 ticket, const QImage& image)
+{
+  // Dropped or rendered again since this render started
+  const auto expected{this->pending.constFind(key)};
+  if (expected == this->pending.cend() || expected.value() != ticket)
+  {
+    return;
+  }
+  this->pending.erase(expected);
+  if (image.isNull())
+  {
+    return;
+  }
+
+  this->tiles.insert(key, Tile{image, ++this->useCounter});
+  this->memory += image.sizeInBytes();
+  this->evict();
+  emit this->tileReady(
+    key.level,
+    QRect{key.x * tileSize, key.y * tileSize, tileSize, tileSize});
+}
+
+void TileCache::evict()
+{
+  while (this->memory > this->memoryLimit && !this->tiles.isEmpty())
+  {
+    // A few hundred tiles at most, a scan is cheaper than keeping order
+    const auto oldest{std::min_element(
+      this->tiles.begin(),
+      this->tiles.end(),
+      [](const Tile& a, const Tile& b)
+      {
+        return a.used < b.used;
+      })};
+    this->memory -= oldest->image.sizeInBytes();
+    this->tiles.erase(oldest);
+  }
+}
+
+QRect TileCache::tileRange(const QRect& rect, const QPoint& origin)
+{
+  const QRect r{rect.translated(-origin)};
+  const auto tile = [](const int v)
+  {
+    // Rounds towards minus infinity, left and above the origin too
+    return v >= 0 ? v / tileSize : -((-v - 1) / tileSize) - 1;
+  };
+  return QRect{
+    QPoint{tile(r.left()), tile(r.top())},
+    QPoint{tile(r.right()), tile(r.bottom())}};
+}
+
+QRectF TileCache::sceneArea(const Key& key)
+{
+  // A pixel of room for strokes and dots rounded outwards
+  const qreal zoom{levelZoom(key.level)};
+  const qreal side{tileSize / zoom};
+  const qreal margin{2.0 / zoom};
+  return QRectF{
+    key.x * side - margin,
+    key.y * side - margin,
+    side + 2.0 * margin,
+    side + 2.0 * margin};
+}
+
+QImage
+TileCache::render(const SceneSnapshot& scene, const Key& key, const qreal dpr)
+{
+  const TraceSpan span{"cache tile", "worker"};
+  QImage image{
+    QSize{tileSize, tileSize} * dpr, QImage::Format_ARGB32_Premultiplied};
+  if (image.isNull())
+  {
+    return image;
+  }
+  image.setDevicePixelRatio(dpr);
+  image.fill(Qt::white);
+
+  // Tiles are the finished picture, antialiased like a saved image and
+  // reduced only where the zoom leaves shapes a few pixels
+  const qreal zoom{levelZoom(key.level)};
+  const QPointF offset{
+    static_cast<qreal>(-key.x * tileSize),
+    static_cast<qreal>(-key.y * tileSize)};
+  QPainter p{&image};
+  p.setRenderHint(QPainter::Antialiasing, true);
+  p.setTransform(QTransform{zoom, 0.0, 0.0, zoom, offset.x(), offset.y()});
+
+  thread_local PaintStyles styles{};
+  styles.setView(QSize{tileSize, tileSize}, zoom, offset, dpr, false);
+
+  const qreal side{tileSize / zoom};
+  const qreal margin{scene.maxShapeWidth / 2.0 + 2.0 / zoom};
+  QVector<int> visible{scene.index.query(
+    QRectF{key.x * side - margin,
+           key.y * side - margin,
+           side + 2.0 * margin,
+           side + 2.0 * margin})};
+  std::ranges::sort(visible);
+
+  const ShapeStore& shapes{scene.shapes};
+  const bool fill{scene.settings.fill};
+  std::ranges::for_each(
+    visible,
+    [&shapes, &p, fill](const int i)
+    {
+      // The store shares its paths with the canvas
+      if (!styles.drawReduced(p, shapes, i, fill, shapes.bounds(i)))
+      {
+        SceneSnapshot::drawShapeOnWorker(p, shapes, i, fill, styles);
+      }
+    });
+  return image;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "scenesnapshot.hpp"
+
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPainter>
+#include <QRegion>
+#include <QThreadPool>
+
+// Antialiased raster tiles of the scene as the canvas shows it, keyed by
+// zoom level and tile coordinate. Tile (x, y) of a level covers the widget
+// pixels from (x, y) * tileSize on, before the pan is added, so a pan by
+// whole pixels only changes where the tiles are copied to. Missing tiles
+// are rendered on a private pool from a snapshot of the scene and announced
+// with tileReady; the least recently drawn ones go once the memory limit is
+// reached. Edits drop the tiles they touch and forget the renders under
+// way for them, so a result only lands while its tile still expects it.
+class TileCache : public QObject
+{
+  Q_OBJECT
+
+public:
+  static constexpr int tileSize{256};
+  // Zoom levels are steps of a quarter octave from a zoom of one
+  static constexpr int levelsPerOctave{4};
+
+  explicit TileCache(QObject* const parent = nullptr);
+  // Drops queued tiles and waits for the running ones
+  ~TileCache() override;
+
+  static qreal levelZoom(const int level);
+
+  qsizetype getMemoryLimit() const;
+  void setMemoryLimit(const qsizetype newMemoryLimit);
+  qsizetype memoryUsage() const;
+  qsizetype size() const;
+
+  // Copies the cached tiles of level inside region to the painter, which
+  // paints widget pixels, with the scene origin at origin. Returns the part
+  // of region no tile was found for
+  QRegion draw(
+    QPainter& p,
+    const QRegion& region,
+    const int level,
+    const QPoint& origin,
+    const qreal dpr);
+  // Starts rendering the tiles of level covering rect that are neither
+  // cached nor on their way
+  void request(
+    const QRect& rect,
+    const int level,
+    const QPoint& origin,
+    const qreal dpr,
+    const SceneSnapshot& scene);
+  // Drops every tile showing a part of the scene rectangle
+  void invalidate(const QRectF& sceneRect);
+  void clear();
+
+signals:
+  // Tile pixels of level, without the pan
+  void tileReady(const int level, const QRect& rect);
+
+private:
+  struct Key
+  {
+    int level{0};
+    int x{0};
+    int y{0};
+
+    bool operator==(const Key& other) const = default;
+    friend size_t qHash(const Key& key, const size_t seed = 0)
+    {
+      return qHashMulti(seed, key.level, key.x, key.y);
+    }
+  };
+
+  struct Tile
+  {
+    QImage image{};
+    // Value of the use counter when the tile was last drawn
+    quint64 used{0};
+  };
+
+  QHash<Key, Tile> tiles{};
+  // Tiles being rendered, each with the ticket of its latest render. Only
+  // the result carrying that ticket is kept
+  QHash<Key, quint64> pending{};
+  qsizetype memoryLimit{128 * 1024 * 1024};
+  qsizetype memory{0};
+  quint64 useCounter{0};
+  quint64 ticketCounter{0};
+  int requestedLevel{0};
+  qreal dpr{1.0};
+  QThreadPool pool{};
+
+  void useRatio(const qreal newDpr);
+  void finish(const Key& key, const quint64 ticket, const QImage& image);
+  void evict();
+  static QRect tileRange(const QRect& rect, const QPoint& origin);
+  // Scene rectangle whose shapes can reach the pixels of the tile
+  static QRectF sceneArea(const Key& key);
+  static QImage
+  render(const SceneSnapshot& scene, const Key& key, const qreal dpr);
+};
@@ -0,0 +1,65 @@
+#include "tilerenderer.hpp"
+#include "traceevents.hpp"
+
+#include <QtConcurrent>
+
+TileRenderer::TileRenderer(const int tileSize) : tileSize{qMax(16, tileSize)}
+{
+}
+
+int TileRenderer::getTileSize() const
+{
+  return this->tileSize;
+}
+
+void TileRenderer::setTileSize(const int newTileSize)
+{
+  this->tileSize = qMax(16, newTileSize);
+}
+
+QImage TileRenderer::render(
+  const QSize& size, const QColor& background, const DrawTile& draw) const
+{
+  QImage target{size, QImage::Format_ARGB32_Premultiplied};
+  if (target.isNull())
+  {
+    return target;
+  }
+  target.fill(background);
+
+  QVector<QRect> tiles{};
+  for (int y{0}; y < size.height(); y += this->tileSize)
+  {
+    for (int x{0}; x < size.width(); x += this->tileSize)
+    {
+      tiles.push_back(QRect{
+        x,
+        y,
+        qMin(this->tileSize, size.width() - x),
+        qMin(this->tileSize, size.height() - y)});
+    }
+  }
+
+  // Detach once here, the workers only get raw views into the buffer
+  uchar* const bits{target.bits()};
+  const qsizetype bytesPerLine{target.bytesPerLine()};
+  const QImage::Format format{target.format()};
+
+  QtConcurrent::blockingMap(
+    tiles,
+    [bits, bytesPerLine, format, &draw](const QRect& tile)
+    {
+      const TraceSpan span{"tile", "worker"};
+      QImage view{
+        bits + tile.y() * bytesPerLine + tile.x() * sizeof(QRgb),
+        tile.width(),
+        tile.height(),
+        bytesPerLine,
+        format};
+      QPainter p{&view};
+      p.translate(-tile.x(), -tile.y());
+      draw(p, tile);
+    });
+
+  return target;
+}
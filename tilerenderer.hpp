@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QImage>
+#include <QPainter>
+#include <QRect>
+#include <QSize>
+
+// C++ standard
+#include <functional>
+
+// Splits a target image into tiles and rasterizes them in parallel on the
+// global thread pool, one QPainter per tile. Every tile paints straight into
+// its part of the target buffer through a translated painter, so the result
+// matches a single painter covering the whole image.
+class TileRenderer
+{
+public:
+  // Called concurrently from worker threads; the painter is already
+  // translated so scene coordinates can be used as they are
+  using DrawTile = std::function<void(QPainter& p, const QRect& tile)>;
+
+  // Tiles are at least 16 pixels wide and high
+  explicit TileRenderer(const int tileSize = 256);
+
+  int getTileSize() const;
+  void setTileSize(const int newTileSize);
+
+  QImage render(
+    const QSize& size, const QColor& background, const DrawTile& draw) const;
+
+private:
+  int tileSize{256};
+};
@@ -0,0 +1,165 @@
+#include "traceevents.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+
+// C++ standard
+#include <algorithm>
+#include <cstring>
+#include <ranges>
+
+namespace
+{
+struct Record
+{
+  const char* name{nullptr};
+  const char* category{nullptr};
+  qint64 startNs{0};
+  qint64 endNs{0};
+  int thread{0};
+};
+
+QMutex mutex{};
+QVector<Record> records{};
+QHash<int, QString> threadNames{};
+QString outputPath{};
+qsizetype dropped{0};
+QElapsedTimer timer{};
+std::atomic<int> nextThread{1};
+thread_local int currentThread{0};
+
+// Trace files want small numbers, a thread gets one on its first span
+int threadNumber()
+{
+  if (currentThread == 0)
+  {
+    currentThread = nextThread.fetch_add(1, std::memory_order_relaxed);
+  }
+  return currentThread;
+}
+
+QString threadName()
+{
+  const QThread* const thread{QThread::currentThread()};
+  if (
+    QCoreApplication::instance() != nullptr &&
+    thread == QCoreApplication::instance()->thread())
+  {
+    return QString{"main"};
+  }
+  return thread->objectName().isEmpty()
+           ? QString{"worker %1"}.arg(threadNumber())
+           : thread->objectName();
+}
+
+QByteArray quoted(const QString& text)
+{
+  QByteArray escaped{text.toUtf8()};
+  escaped.replace("\\", "\\\\");
+  escaped.replace("\"", "\\\"");
+  return '"' + escaped + '"';
+}
+} // namespace
+
+void TraceEvents::startFromCommandLine(const int argc, char* argv[])
+{
+  QString path{qEnvironmentVariable(environmentName)};
+  for (int i{1}; i + 1 < argc; ++i)
+  {
+    if (std::strcmp(argv[i], switchName) == 0)
+    {
+      path = QString::fromLocal8Bit(argv[i + 1]);
+    }
+  }
+  if (!path.isEmpty())
+  {
+    start(path);
+  }
+}
+
+void TraceEvents::start(const QString& path)
+{
+  const QMutexLocker locker{&mutex};
+  records.clear();
+  threadNames.clear();
+  dropped = 0;
+  outputPath = path;
+  timer.start();
+  enabled.store(true, std::memory_order_relaxed);
+}
+
+bool TraceEvents::stop()
+{
+  if (!enabled.exchange(false))
+  {
+    return false;
+  }
+
+  // Spans still running on other threads find recording off and drop
+  // their event, those already inside record() finish first
+  const QMutexLocker locker{&mutex};
+  QByteArray json{"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"};
+  for (const auto& [thread, name] : threadNames.asKeyValueRange())
+  {
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+            QByteArray::number(thread) + ",\"args\":{\"name\":" +
+            quoted(name) + "}},\n";
+  }
+  std::ranges::for_each(
+    records,
+    [&json](const Record& record)
+    {
+      // Microseconds with the nanoseconds kept as fraction
+      json += QByteArray{"{\"name\":\""} + record.name + "\",\"cat\":\"" +
+              record.category + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" +
+              QByteArray::number(record.thread) +
+              ",\"ts\":" + QByteArray::number(record.startNs / 1000.0, 'f', 3) +
+              ",\"dur\":" +
+              QByteArray::number(
+                (record.endNs - record.startNs) / 1000.0, 'f', 3) +
+              "},\n";
+    });
+  json += "{\"name\":\"dropped_events\",\"ph\":\"M\",\"pid\":1,\"args\":"
+          "{\"count\":" +
+          QByteArray::number(dropped) + "}}\n]}\n";
+  records.clear();
+  threadNames.clear();
+
+  QSaveFile file{outputPath};
+  return file.open(QIODevice::WriteOnly) && file.write(json) == json.size() &&
+         file.commit();
+}
+
+qint64 TraceEvents::now()
+{
+  return timer.nsecsElapsed();
+}
+
+void TraceEvents::record(
+  const char* name,
+  const char* category,
+  const qint64 startNs,
+  const qint64 endNs)
+{
+  const int thread{threadNumber()};
+  const QMutexLocker locker{&mutex};
+  if (!isEnabled())
+  {
+    return;
+  }
+  if (records.size() >= maxEvents)
+  {
+    ++dropped;
+    return;
+  }
+  if (!threadNames.contains(thread))
+  {
+    threadNames.insert(thread, threadName());
+  }
+  records.push_back(Record{name, category, startNs, endNs, thread});
+}
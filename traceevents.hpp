@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QString>
+
+// C++ standard
+#include <atomic>
+
+// Records spans around the expensive operations as Chrome trace events,
+// for chrome://tracing or ui.perfetto.dev. Recording is switched on by the
+// SHAPES_TRACE_EVENTS environment variable or the --trace-events switch,
+// either naming the JSON file written when recording stops. Spans are kept
+// in memory until then. While recording is off a span costs one relaxed
+// atomic load, so they stay compiled into every build.
+class TraceEvents
+{
+public:
+  static constexpr const char* switchName{"--trace-events"};
+  static constexpr const char* environmentName{"SHAPES_TRACE_EVENTS"};
+  // Further spans are dropped, about 100 MB of them
+  static constexpr qsizetype maxEvents{1 << 22};
+
+  // Starts recording if the command line or the environment names a file,
+  // the command line wins
+  static void startFromCommandLine(const int argc, char* argv[]);
+  static void start(const QString& path);
+  // Writes the file. Returns false if that failed or nothing was recorded
+  static bool stop();
+
+  static bool isEnabled()
+  {
+    return enabled.load(std::memory_order_relaxed);
+  }
+  // Nanoseconds since recording started
+  static qint64 now();
+  // Name and category have to live until stop(), pass string literals
+  static void record(
+    const char* name,
+    const char* category,
+    const qint64 startNs,
+    const qint64 endNs);
+
+private:
+  static inline std::atomic<bool> enabled{false};
+};
+
+// One complete event from construction to destruction of the span
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const char* name, const char* category = "app")
+    : name{name}, category{category}
+  {
+    if (TraceEvents::isEnabled())
+    {
+      this->startNs = TraceEvents::now();
+    }
+  }
+
+  ~TraceSpan()
+  {
+    if (this->startNs >= 0)
+    {
+      TraceEvents::record(
+        this->name, this->category, this->startNs, TraceEvents::now());
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+  const char* name{nullptr};
+  const char* category{nullptr};
+  qint64 startNs{-1};
+};
@@ -0,0 +1,175 @@
+#include "undostack.hpp"
+
+// C++ standard
+#include <algorithm>
+#include <ranges>
+#include <utility>
+
+qsizetype UndoStack::getMemoryLimit() const
+{
+  return this->memoryLimit;
+}
+
+void UndoStack::setMemoryLimit(const qsizetype newMemoryLimit)
+{
+  this->memoryLimit = qMax(qsizetype{0}, newMemoryLimit);
+  this->trim();
+}
+
+qsizetype UndoStack::memoryUsage() const
+{
+  return this->usage;
+}
+
+bool UndoStack::canUndo() const
+{
+  return !this->undoSteps.isEmpty();
+}
+
+bool UndoStack::canRedo() const
+{
+  return !this->redoSteps.isEmpty();
+}
+
+qsizetype UndoStack::undoCount() const
+{
+  return this->undoSteps.size();
+}
+
+qsizetype UndoStack::redoCount() const
+{
+  return this->redoSteps.size();
+}
+
+void UndoStack::push(const SceneEdit& edit, const SceneEdit& inverse)
+{
+  std::ranges::for_each(
+    this->redoSteps,
+    [this](const Step& step)
+    {
+      this->usage -= step.cost;
+    });
+  this->redoSteps.clear();
+
+  if (this->grouping && this->groupStarted && !this->undoSteps.isEmpty())
+  {
+    Step& step{this->undoSteps.last()};
+    if (
+      canMerge(step.edits.last(), edit) &&
+      canMerge(step.inverses.last(), inverse))
+    {
+      merge(step.edits.last(), edit);
+      merge(step.inverses.last(), inverse);
+    }
+    else
+    {
+      const qsizetype cost{costOf(edit) + costOf(inverse)};
+      step.edits.push_back(edit);
+      step.inverses.push_back(inverse);
+      step.cost += cost;
+      this->usage += cost;
+    }
+  }
+  else
+  {
+    Step step{};
+    step.edits.push_back(edit);
+    step.inverses.push_back(inverse);
+    step.cost = costOf(edit) + costOf(inverse);
+    this->usage += step.cost;
+    this->undoSteps.push_back(std::move(step));
+    this->groupStarted = this->grouping;
+  }
+  this->trim();
+}
+
+bool UndoStack::fits(const qsizetype cost) const
+{
+  return cost <= this->memoryLimit;
+}
+
+void UndoStack::beginGroup()
+{
+  this->grouping = true;
+  this->groupStarted = false;
+}
+
+void UndoStack::endGroup()
+{
+  this->grouping = false;
+  this->groupStarted = false;
+}
+
+QVector<SceneEdit> UndoStack::undo()
+{
+  this->endGroup();
+  if (this->undoSteps.isEmpty())
+  {
+    return {};
+  }
+
+  Step step{this->undoSteps.takeLast()};
+  QVector<SceneEdit> edits{step.inverses};
+  std::ranges::reverse(edits);
+  this->redoSteps.push_back(std::move(step));
+  return edits;
+}
+
+QVector<SceneEdit> UndoStack::redo()
+{
+  this->endGroup();
+  if (this->redoSteps.isEmpty())
+  {
+    return {};
+  }
+
+  Step step{this->redoSteps.takeLast()};
+  const QVector<SceneEdit> edits{step.edits};
+  this->undoSteps.push_back(std::move(step));
+  return edits;
+}
+
+void UndoStack::clear()
+{
+  this->undoSteps.clear();
+  this->redoSteps.clear();
+  this->usage = 0;
+  this->groupStarted = false;
+}
+
+qsizetype UndoStack::costOf(const SceneEdit& edit)
+{
+  return static_cast<qsizetype>(sizeof(SceneEdit)) +
+         edit.indices.capacity() * static_cast<qsizetype>(sizeof(int)) +
+         edit.shapes.capacity() * static_cast<qsizetype>(sizeof(Shape));
+}
+
+bool UndoStack::canMerge(const SceneEdit& into, const SceneEdit& edit)
+{
+  // Shapes turn about their own centers, so transforms of the same shapes
+  // add up exactly
+  return into.kind == SceneEdit::Kind::Transform &&
+         edit.kind == SceneEdit::Kind::Transform &&
+         into.indices == edit.indices;
+}
+
+void UndoStack::merge(SceneEdit& into, const SceneEdit& edit)
+{
+  into.offset += edit.offset;
+  into.rotation += edit.rotation;
+}
+
+void UndoStack::trim()
+{
+  // Oldest history first, then the redo steps furthest away
+  while (this->usage > this->memoryLimit && !this->undoSteps.isEmpty())
+  {
+    this->usage -= this->undoSteps.takeFirst().cost;
+  }
+  // The open group lost its step, a later edit of it starts a new one
+  this->groupStarted = this->groupStarted && !this->undoSteps.isEmpty();
+  while (this->usage > this->memoryLimit && !this->redoSteps.isEmpty())
+  {
+    this->usage -= this->redoSteps.takeFirst().cost;
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "sceneedit.hpp"
+
+#include <QVector>
+
+// Undo and redo history of the scene. A step holds the edits that were made
+// and the edits that reverse them, so it costs as much as the change and
+// not the scene: a move keeps the positions and the transform, a delete
+// the removed shapes, a clone only the positions. Edits pushed while a
+// group is open, such as one mouse gesture, form a single step, and
+// consecutive transforms of the same shapes in it merge into one. The
+// oldest steps are dropped once the history outgrows its memory limit.
+class UndoStack
+{
+public:
+  static constexpr qsizetype defaultMemoryLimit{64 * 1024 * 1024};
+
+  qsizetype getMemoryLimit() const;
+  void setMemoryLimit(const qsizetype newMemoryLimit);
+  // Approximate heap footprint of the undo and redo steps
+  qsizetype memoryUsage() const;
+
+  bool canUndo() const;
+  bool canRedo() const;
+  qsizetype undoCount() const;
+  qsizetype redoCount() const;
+
+  // edit has just been made and inverse reverses it. Drops the redo steps
+  void push(const SceneEdit& edit, const SceneEdit& inverse);
+  // Whether a step costing cost bytes can be kept at all
+  bool fits(const qsizetype cost) const;
+  void beginGroup();
+  void endGroup();
+
+  // Edits reversing the newest step, in the order to apply them. The step
+  // moves over to the redo side
+  QVector<SceneEdit> undo();
+  // Edits repeating the step undone last, in the order to apply them
+  QVector<SceneEdit> redo();
+  void clear();
+
+  static qsizetype costOf(const SceneEdit& edit);
+
+private:
+  struct Step
+  {
+    QVector<SceneEdit> edits{};
+    QVector<SceneEdit> inverses{};
+    qsizetype cost{0};
+  };
+
+  QVector<Step> undoSteps{};
+  // Next step to redo last
+  QVector<Step> redoSteps{};
+  qsizetype memoryLimit{defaultMemoryLimit};
+  qsizetype usage{0};
+  bool grouping{false};
+  // Whether the open group has a step on the undo side yet
+  bool groupStarted{false};
+
+  static bool canMerge(const SceneEdit& into, const SceneEdit& edit);
+  static void merge(SceneEdit& into, const SceneEdit& edit);
+  void trim();
+};